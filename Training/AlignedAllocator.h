@@ -0,0 +1,50 @@
+///////////////////////////////////////////////////////////////////////////////
+//             Machine Learning Introduction For Game Developers             //
+//         Copyright (c) 2023 Electronic Arts Inc. All rights reserved.      //
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <new>
+#include <vector>
+
+// An allocator for std::vector that aligns the storage to ALIGNMENT bytes, and rounds the allocation size up to a multiple of ALIGNMENT.
+// With 64 byte alignment, that means two different vectors never share a cache line, so different threads can write to them
+// without false sharing, and SIMD code can use aligned loads and stores.
+
+template <typename T, size_t ALIGNMENT = 64>
+struct AlignedAllocator
+{
+	using value_type = T;
+
+	template <typename U>
+	struct rebind
+	{
+		using other = AlignedAllocator<U, ALIGNMENT>;
+	};
+
+	AlignedAllocator() = default;
+
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U, ALIGNMENT>&) {}
+
+	T* allocate(size_t count)
+	{
+		size_t size = ((count * sizeof(T) + ALIGNMENT - 1) / ALIGNMENT) * ALIGNMENT;
+		return (T*)::operator new(size, std::align_val_t(ALIGNMENT));
+	}
+
+	void deallocate(T* p, size_t count)
+	{
+		::operator delete(p, std::align_val_t(ALIGNMENT));
+	}
+
+	template <typename U>
+	bool operator == (const AlignedAllocator<U, ALIGNMENT>&) const { return true; }
+
+	template <typename U>
+	bool operator != (const AlignedAllocator<U, ALIGNMENT>&) const { return false; }
+};
+
+template <typename T, size_t ALIGNMENT = 64>
+using AlignedVector = std::vector<T, AlignedAllocator<T, ALIGNMENT>>;
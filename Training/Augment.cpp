@@ -0,0 +1,184 @@
+///////////////////////////////////////////////////////////////////////////////
+//             Machine Learning Introduction For Game Developers             //
+//         Copyright (c) 2023 Electronic Arts Inc. All rights reserved.      //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Augment.h"
+#include "SIMD.h"
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+ImageAugmenter::ImageAugmenter(uint32_t seed)
+	: m_rng(seed)
+	, m_sampleX(c_imagePixels)
+	, m_sampleY(c_imagePixels)
+	, m_source(c_paddedWidth * c_paddedHeight, 0.0f)
+{
+	// A normalized gaussian out to 3 sigma
+	size_t radius = std::max(size_t(std::ceil(3.0f * c_augmentElasticSigma)), size_t(1));
+	m_gaussianKernel.resize(2 * radius + 1);
+	float sum = 0.0f;
+	for (size_t tap = 0; tap < m_gaussianKernel.size(); ++tap)
+	{
+		float offset = float(tap) - float(radius);
+		m_gaussianKernel[tap] = std::exp(-offset * offset / (2.0f * c_augmentElasticSigma * c_augmentElasticSigma));
+		sum += m_gaussianKernel[tap];
+	}
+	for (float& weight : m_gaussianKernel)
+		weight /= sum;
+
+	m_fieldStride = c_imageWidth + 2 * radius;
+	m_noise.resize(c_imageHeight * m_fieldStride, 0.0f);
+	m_horizontal.resize((c_imageHeight + 2 * radius) * m_fieldStride, 0.0f);
+	m_displacementX.resize(c_imageHeight * m_fieldStride);
+	m_displacementY.resize(c_imageHeight * m_fieldStride);
+}
+
+void ImageAugmenter::Augment(const uint8_t* source, uint8_t* dest)
+{
+	MakeSamplePositions();
+	Resample(source, dest);
+}
+
+void ImageAugmenter::Augment(const float* source, float* dest)
+{
+	MakeSamplePositions();
+	Resample(source, dest);
+}
+
+// Makes a field of random displacements in [-1, 1], blurred by the gaussian, and scaled by the elastic alpha.
+// Pixels outside of the image count as 0 when blurring.
+//
+// The blur is done with AddScaled from SIMD.h, adding each tap of the kernel to the whole image at once. The noise is stored with
+// radius columns of zeros on either side of each row, and the horizontal pass output with radius rows of zeros above and below,
+// so each tap is a single AddScaled over the flattened image, and reading past the ends of a row or column reads zeros.
+// The field is stored with the same padded row stride, m_fieldStride.
+void ImageAugmenter::MakeDisplacementField(std::vector<float>& field)
+{
+	const SIMDKernels& kernels = GetSIMDKernels();
+	const size_t radius = m_gaussianKernel.size() / 2;
+
+	// A xorshift generator seeded from m_rng is a lot faster than using a distribution for every value, and is random enough for this
+	uint32_t state = m_rng() | 1;
+	for (size_t y = 0; y < c_imageHeight; ++y)
+	{
+		float* row = &m_noise[y * m_fieldStride + radius];
+		for (size_t x = 0; x < c_imageWidth; ++x)
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			row[x] = float(state) * (2.0f / 4294967296.0f) - 1.0f;
+		}
+	}
+
+	// Horizontal pass, from m_noise into the rows of m_horizontal between the zero rows
+	float* horizontal = &m_horizontal[radius * m_fieldStride];
+	size_t horizontalCount = c_imageHeight * m_fieldStride - 2 * radius;
+	std::fill(horizontal, horizontal + horizontalCount, 0.0f);
+	for (size_t tap = 0; tap < m_gaussianKernel.size(); ++tap)
+		kernels.AddScaled(horizontal, &m_noise[tap], m_gaussianKernel[tap], horizontalCount);
+
+	// Vertical pass, from m_horizontal into field
+	std::fill(field.begin(), field.end(), 0.0f);
+	for (size_t tap = 0; tap < m_gaussianKernel.size(); ++tap)
+		kernels.AddScaled(field.data(), &m_horizontal[tap * m_fieldStride], m_gaussianKernel[tap] * c_augmentElasticAlpha, c_imageHeight * m_fieldStride);
+}
+
+void ImageAugmenter::MakeSamplePositions()
+{
+	static const float c_pi = 3.14159265359f;
+	const SIMDKernels& kernels = GetSIMDKernels();
+
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	float angle = unit(m_rng) * c_augmentMaxRotation * c_pi / 180.0f;
+	float scale = 1.0f + unit(m_rng) * c_augmentMaxScale;
+	float translateX = unit(m_rng) * c_augmentMaxTranslation;
+	float translateY = unit(m_rng) * c_augmentMaxTranslation;
+
+	if (c_augmentElasticAlpha > 0.0f)
+	{
+		MakeDisplacementField(m_displacementX);
+		MakeDisplacementField(m_displacementY);
+	}
+
+	// The transform goes from source to destination, so each destination pixel reads from the inverse transform of its position:
+	// source = rotate(-angle, dest - center - translation) / scale + center
+	float cosAngle = std::cos(angle) / scale;
+	float sinAngle = std::sin(angle) / scale;
+	float centerX = float(c_imageWidth - 1) / 2.0f;
+	float centerY = float(c_imageHeight - 1) / 2.0f;
+
+	for (size_t y = 0; y < c_imageHeight; ++y)
+	{
+		float relativeY = float(y) - centerY - translateY;
+		for (size_t x = 0; x < c_imageWidth; ++x)
+		{
+			float relativeX = float(x) - centerX - translateX;
+			size_t index = y * c_imageWidth + x;
+			m_sampleX[index] = cosAngle * relativeX + sinAngle * relativeY + centerX;
+			m_sampleY[index] = -sinAngle * relativeX + cosAngle * relativeY + centerY;
+		}
+	}
+
+	if (c_augmentElasticAlpha > 0.0f)
+	{
+		for (size_t y = 0; y < c_imageHeight; ++y)
+		{
+			kernels.AddScaled(&m_sampleX[y * c_imageWidth], &m_displacementX[y * m_fieldStride], 1.0f, c_imageWidth);
+			kernels.AddScaled(&m_sampleY[y * c_imageWidth], &m_displacementY[y * m_fieldStride], 1.0f, c_imageWidth);
+		}
+	}
+}
+
+template <typename T>
+void ImageAugmenter::Resample(const T* source, T* dest)
+{
+	// Copy the source into the middle of m_source, which has a border of zeros: 1 pixel on the top and left, 2 on the bottom and right.
+	// Clamping the sample positions to [-1, size] then means the 4 bilinear taps are always in m_source, and are 0 when outside of the image,
+	// so the loop below has no branches.
+	for (size_t y = 0; y < c_imageHeight; ++y)
+	{
+		float* row = &m_source[(y + 1) * c_paddedWidth + 1];
+		for (size_t x = 0; x < c_imageWidth; ++x)
+			row[x] = float(source[y * c_imageWidth + x]);
+	}
+
+	for (size_t index = 0; index < c_imagePixels; ++index)
+	{
+		float sampleX = std::clamp(m_sampleX[index], -1.0f, float(c_imageWidth));
+		float sampleY = std::clamp(m_sampleY[index], -1.0f, float(c_imageHeight));
+
+		// The positions are clamped to be >= -1, so adding 1 makes them positive, and converting to int is floor
+		int paddedX = int(sampleX + 1.0f);
+		int paddedY = int(sampleY + 1.0f);
+		float fractionX = sampleX + 1.0f - float(paddedX);
+		float fractionY = sampleY + 1.0f - float(paddedY);
+		const float* topLeft = &m_source[paddedY * c_paddedWidth + paddedX];
+
+		// Bilinear is separable: lerp across x on both rows, then across y
+		float top = topLeft[0] + (topLeft[1] - topLeft[0]) * fractionX;
+		float bottom = topLeft[c_paddedWidth] + (topLeft[c_paddedWidth + 1] - topLeft[c_paddedWidth]) * fractionX;
+		float value = top + (bottom - top) * fractionY;
+
+		if constexpr (std::is_same_v<T, uint8_t>)
+			dest[index] = (uint8_t)std::min(value + 0.5f, 255.0f);
+		else
+			dest[index] = value;
+	}
+}
+
+void AugmentDataItem(const DataItem& source, DataItem& dest, ImageAugmenter& augmenter)
+{
+	dest.label = source.label;
+	augmenter.Augment(source.image, dest.image);
+	dest.image[c_imagePixels] = 1.0f;
+}
+
+void AugmentDataItem(const CompactDataItem& source, CompactDataItem& dest, ImageAugmenter& augmenter)
+{
+	dest.label = source.label;
+	augmenter.Augment(source.pixels, dest.pixels);
+}
@@ -0,0 +1,63 @@
+///////////////////////////////////////////////////////////////////////////////
+//             Machine Learning Introduction For Game Developers             //
+//         Copyright (c) 2023 Electronic Arts Inc. All rights reserved.      //
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <random>
+#include <stdint.h>
+#include <vector>
+#include "DataSet.h"
+
+// Makes randomly distorted copies of training images, so the network sees a slightly different version of each image every epoch,
+// which helps it generalize to the testing data.
+//
+// Each image gets a random affine transform (rotation, scale and translation about the center), and a random elastic distortion.
+// The elastic distortion is a random displacement for each pixel, blurred with a gaussian so that neighboring pixels move together,
+// as described in "Best Practices for Convolutional Neural Networks Applied to Visual Document Analysis" by Simard et al.
+//
+// The transform and the distortion are combined into a source position for every destination pixel, which is then bilinearly sampled,
+// with pixels outside of the image being 0. Everything is done in flat arrays, one pass at a time, with padding instead of bounds checks.
+// The gaussian blur is separable, done as a horizontal pass and then a vertical pass, using the AddScaled kernel from SIMD.h.
+//
+// Each thread needs its own ImageAugmenter, since it has scratch memory and a random number generator.
+class ImageAugmenter
+{
+public:
+	explicit ImageAugmenter(uint32_t seed);
+
+	void Augment(const uint8_t* source, uint8_t* dest);
+	void Augment(const float* source, float* dest);
+
+private:
+	static constexpr size_t c_paddedWidth = c_imageWidth + 3;
+	static constexpr size_t c_paddedHeight = c_imageHeight + 3;
+
+	void MakeSamplePositions();
+	void MakeDisplacementField(std::vector<float>& field);
+
+	template <typename T>
+	void Resample(const T* source, T* dest);
+
+	std::mt19937 m_rng;
+	std::vector<float> m_gaussianKernel;
+
+	// Where in the source image each destination pixel reads from
+	std::vector<float> m_sampleX;
+	std::vector<float> m_sampleY;
+
+	// The source image as floats, with a border of zeros
+	std::vector<float> m_source;
+
+	// The elastic displacements, and scratch space for making them. The rows are padded for the blur, to m_fieldStride floats.
+	size_t m_fieldStride = 0;
+	std::vector<float> m_noise;
+	std::vector<float> m_horizontal;
+	std::vector<float> m_displacementX;
+	std::vector<float> m_displacementY;
+};
+
+// Makes an augmented copy of a training item. For DataItems, the bias term is set in the new image.
+void AugmentDataItem(const DataItem& source, DataItem& dest, ImageAugmenter& augmenter);
+void AugmentDataItem(const CompactDataItem& source, CompactDataItem& dest, ImageAugmenter& augmenter);
@@ -6,156 +6,478 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include "DataSet.h"
+#include "IDXFile.h"
+#include "MappedFile.h"
 
 #include <vector>
 #include <stdint.h>
+#include <string.h>
 #include <direct.h>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <string>
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "../Demo/mnist/DX12Utils/stb/stb_image_write.h"
 
-typedef std::vector<uint8_t> Bytes;
+// The label and image files are memory mapped, so the labels and pixels are spans directly over the file contents.
+// Nothing is read from disk until it's touched.
+struct DataFiles
+{
+	IDXFile labelFile;
+	uint32_t labelCount = 0;
+	std::span<const uint8_t> labels;
+
+	IDXFile imageFile;
+	uint32_t imageCount = 0;
+	std::span<const uint8_t> pixels;
+};
 
-inline uint32_t EndianSwap(uint32_t a)
+bool IsValidDataSet(const IDXFile& labelFile, const IDXFile& imageFile)
 {
-	return (a << 24) | ((a << 8) & 0x00ff0000) |
-		((a >> 8) & 0x0000ff00) | (a >> 24);
+	// Labels are a 1D array of bytes, each less than the number of classes
+	if (!labelFile.IsOpen() || labelFile.DataType() != IDXFile::Type::UInt8 || labelFile.Dims().size() != 1)
+		return false;
+	std::span<const uint8_t> labels = labelFile.Data();
+	if (std::any_of(labels.begin(), labels.end(), [](uint8_t label) { return label >= c_numClasses; }))
+	{
+		printf("ERROR: %s has labels that are not less than the %i classes of %s.\n", TDataSetInfo::c_name, (int)c_numClasses, TDataSetInfo::c_name);
+		return false;
+	}
+
+	// Images are a 3D array of bytes: count x height x width, with one image per label
+	if (!imageFile.IsOpen() || imageFile.DataType() != IDXFile::Type::UInt8 || imageFile.Dims().size() != 3)
+		return false;
+	std::span<const uint32_t> imageDims = imageFile.Dims();
+	if (imageDims[1] != c_imageHeight || imageDims[2] != c_imageWidth)
+	{
+		printf("ERROR: the images are %ix%i, but %s images are %ix%i.\n", (int)imageDims[2], (int)imageDims[1], TDataSetInfo::c_name, (int)c_imageWidth, (int)c_imageHeight);
+		return false;
+	}
+	return imageDims[0] == labelFile.ItemCount();
 }
 
-Bytes LoadFileIntoMemory(const char* fileName)
+DataFiles LoadLabelAndDataFile(const char* labelFileName, const char* imageFileName)
 {
-	Bytes ret;
+	DataFiles ret;
 
-	FILE* file = nullptr;
-	fopen_s(&file, fileName, "rb");
-	if (!file)
+	ret.labelFile.Open(DataSetPath(labelFileName).c_str());
+	ret.imageFile.Open(DataSetPath(imageFileName).c_str());
+	if (!IsValidDataSet(ret.labelFile, ret.imageFile))
 		return ret;
 
-	fseek(file, 0, SEEK_END);
-	ret.resize(ftell(file), 0);
-	fseek(file, 0, SEEK_SET);
-
-	fread(ret.data(), 1, ret.size(), file);
+	ret.labelCount = (uint32_t)ret.labelFile.ItemCount();
+	ret.labels = ret.labelFile.Data();
+	ret.imageCount = (uint32_t)ret.imageFile.ItemCount();
+	ret.pixels = ret.imageFile.Data();
 
-	fclose(file);
 	return ret;
 }
 
-struct DataFiles
+void Convert(const DataFiles& dataFiles, const char* outDir)
 {
-	Bytes labelFile;
-	uint32_t labelCount = 0;
-	uint8_t* labels = nullptr;
+	printf("%s...\n", outDir);
 
-	Bytes imageFile;
-	uint32_t imageCount = 0;
-	uint8_t* pixels = nullptr;
+	// Each image is saved as <label>_<n>.png, where it is the nth image with that label.
+	// Working out n for every image ahead of time lets the images be saved in any order, on any thread, with the same file names.
+	std::vector<int> fileIndices(dataFiles.imageCount);
+	{
+		std::array<int, 256> fileCounts = {};
+		for (uint32_t i = 0; i < dataFiles.imageCount; ++i)
+			fileIndices[i] = fileCounts[dataFiles.labels[i]]++;
+	}
+
+	// Save out images.
+	// Only the thread that finishes the image that takes the count past a percent prints it, so each percent is printed once.
+	std::atomic<uint32_t> imagesSaved = 0;
+	#if MULTI_THREADED()
+	#pragma omp parallel for schedule(dynamic, 64)
+	#endif
+	for (int i = 0; i < (int)dataFiles.imageCount; ++i)
+	{
+		char fileName[1024];
+		sprintf(fileName, "%s%i_%i.png", outDir, (int)dataFiles.labels[i], fileIndices[i]);
+		stbi_write_png(fileName, c_imageWidth, c_imageHeight, 1, &dataFiles.pixels[i * c_imagePixels], 0);
+
+		uint32_t saved = ++imagesSaved;
+		int percent = int(100 * uint64_t(saved) / dataFiles.imageCount);
+		int lastPercent = int(100 * uint64_t(saved - 1) / dataFiles.imageCount);
+		if (percent != lastPercent)
+			printf("\r%i%%", percent);
+	}
+	printf("\r100%%\n");
+}
+
+void MakeNonZeroIndices(const DataItem& item, std::vector<uint16_t>& indices)
+{
+	for (int pixelIndex = 0; pixelIndex < c_imagePixels + 1; ++pixelIndex)
+	{
+		if (item.image[pixelIndex] != 0.0f)
+			indices.push_back((uint16_t)pixelIndex);
+	}
+}
+
+void DataSet::MakeNonZeroIndices()
+{
+	std::span<const DataItem> items = Items();
+	m_nonZeroOffsets.resize(items.size() + 1);
+	m_nonZeroIndices.clear();
+	for (size_t itemIndex = 0; itemIndex < items.size(); ++itemIndex)
+	{
+		m_nonZeroOffsets[itemIndex] = (uint32_t)m_nonZeroIndices.size();
+		::MakeNonZeroIndices(items[itemIndex], m_nonZeroIndices);
+	}
+	m_nonZeroOffsets[items.size()] = (uint32_t)m_nonZeroIndices.size();
+	m_nonZeroIndices.shrink_to_fit();
+}
+
+std::span<const uint16_t> DataSet::NonZeroIndices(const DataItem& item) const
+{
+	std::span<const DataItem> items = Items();
+	if (!m_nonZeroOffsets.empty() && !std::less<const DataItem*>()(&item, items.data()) && std::less<const DataItem*>()(&item, items.data() + items.size()))
+	{
+		size_t itemIndex = &item - items.data();
+		return std::span<const uint16_t>{ &m_nonZeroIndices[m_nonZeroOffsets[itemIndex]], m_nonZeroOffsets[itemIndex + 1] - m_nonZeroOffsets[itemIndex] };
+	}
+
+	thread_local std::vector<uint16_t> indices;
+	indices.clear();
+	::MakeNonZeroIndices(item, indices);
+	return indices;
+}
+
+void LoadMNISTData(DataFiles& training, DataFiles& testing)
+{
+	training = LoadLabelAndDataFile(TDataSetInfo::c_trainingLabelFileName, TDataSetInfo::c_trainingImageFileName);
+	testing = LoadLabelAndDataFile(TDataSetInfo::c_testingLabelFileName, TDataSetInfo::c_testingImageFileName);
+}
+
+// Writes the MNIST data out as PNGs, overwriting any that are already there
+void ExtractMNISTPNGs()
+{
+	DataFiles training, testing;
+	LoadMNISTData(training, testing);
+
+	std::string trainingDirectory = DataSetPath("Training/");
+	_mkdir(trainingDirectory.c_str());
+	Convert(training, trainingDirectory.c_str());
+
+	std::string testingDirectory = DataSetPath("Testing/");
+	_mkdir(testingDirectory.c_str());
+	Convert(testing, testingDirectory.c_str());
+}
+
+// The float data set is cached in a binary file in the data set directory, so that later runs can skip parsing the IDX files and converting the images.
+// The file is a DataCacheHeader, followed by the training items, and then the testing items, as DataItems.
+// The header records the layout and normalization of the items, and the size, modification time and hash of each IDX file
+// the cache was made from. If the layout or the size of a file doesn't match, the cache is rebuilt. The IDX files are only hashed
+// when a modification time doesn't match, so a run that uses the cache doesn't read them at all.
+// The items are served straight out of the mapped cache file, instead of being copied out of it. The checksum of the items is
+// checked on every load, so a corrupted cache is rebuilt instead of trained on. It is hashed on all threads, and costs a lot less
+// than converting the IDX files again.
+static const char* c_dataCacheFileName = "DataSet.cache"; // In the data set directory
+static const uint32_t c_dataCacheVersion = 3; // Increment this when DataItem or the way it is filled out changes
+static const char c_dataCacheMagic[8] = "DATASET";
+
+struct DataCacheSource
+{
+	uint64_t size;
+	int64_t modifiedTime;
+	uint64_t hash;
 };
 
-DataFiles LoadLabelAndDataFile(const char* labelFileName, const char* imageFileName)
+struct DataCacheHeader
 {
-	DataFiles ret;
+	char magic[8];
+	uint32_t version;
+
+	// The layout of the items
+	uint32_t itemSize;
+	uint32_t imageWidth;
+	uint32_t imageHeight;
+	uint32_t numClasses;
+	uint32_t pixelType; // An IDXFile::Type
+	float pixelScale; // What the 8 bit pixels were multiplied by
+	uint32_t hasBiasTerm;
+
+	uint64_t trainingCount;
+	uint64_t testingCount;
+	uint64_t checksum; // The hash of the items
+
+	DataCacheSource sources[4];
+};
+
+// A fast 64 bit hash, which is FNV-1a done 8 bytes at a time.
+// This is for noticing changed or corrupted files, it is not meant to be secure.
+uint64_t HashBytes(std::span<const uint8_t> bytes, uint64_t hash = 0xcbf29ce484222325ull)
+{
+	static const uint64_t c_prime = 0x100000001b3ull;
 
-	// Load and verify label data.
-	ret.labelFile = LoadFileIntoMemory(labelFileName);
-	uint32_t* labelData = (uint32_t*)ret.labelFile.data();
-	if (labelData[0] == 0x01080000)
+	size_t index = 0;
+	for (; index + sizeof(uint64_t) <= bytes.size(); index += sizeof(uint64_t))
 	{
-		labelData[0] = EndianSwap(labelData[0]);
-		labelData[1] = EndianSwap(labelData[1]);
+		uint64_t word;
+		memcpy(&word, &bytes[index], sizeof(uint64_t));
+		hash = (hash ^ word) * c_prime;
 	}
-	if (labelData[0] != 2049)
-		return ret;
-	ret.labelCount = labelData[1];
-	ret.labels = (uint8_t*)(&labelData[2]);
+	for (; index < bytes.size(); ++index)
+		hash = (hash ^ bytes[index]) * c_prime;
 
-	// load and verify image data
-	ret.imageFile = LoadFileIntoMemory(imageFileName);
-	uint32_t* imageData = (uint32_t*)ret.imageFile.data();
-	if (imageData[0] == 0x03080000)
+	return hash;
+}
+
+// Hashes the items in blocks on multiple threads, then hashes the block hashes together
+uint64_t HashItems(const DataItem* items, size_t count, uint64_t hash)
+{
+	static const size_t c_blockSize = 1024;
+	std::vector<uint64_t> blockHashes((count + c_blockSize - 1) / c_blockSize);
+
+	#if MULTI_THREADED()
+	#pragma omp parallel for
+	#endif
+	for (int blockIndex = 0; blockIndex < (int)blockHashes.size(); ++blockIndex)
 	{
-		imageData[0] = EndianSwap(imageData[0]);
-		imageData[1] = EndianSwap(imageData[1]);
-		imageData[2] = EndianSwap(imageData[2]);
-		imageData[3] = EndianSwap(imageData[3]);
+		size_t begin = blockIndex * c_blockSize;
+		size_t end = std::min(begin + c_blockSize, count);
+		blockHashes[blockIndex] = HashBytes(std::span<const uint8_t>{ (const uint8_t*)&items[begin], (end - begin) * sizeof(DataItem) });
 	}
-	if (imageData[0] != 2051 || imageData[2] != 28 || imageData[3] != 28) // images are 28x28
-		return ret;
-	ret.imageCount = imageData[1];
-	ret.pixels = (uint8_t*)(&imageData[4]);
 
-	return ret;
+	return HashBytes(std::span<const uint8_t>{ (const uint8_t*)blockHashes.data(), blockHashes.size() * sizeof(uint64_t) }, hash);
 }
 
-void Convert(const DataFiles& dataFiles, const char* outDir)
+uint64_t HashItems(const DataItem* trainingItems, size_t trainingCount, const DataItem* testingItems, size_t testingCount)
 {
-	printf("%s...\n", outDir);
+	uint64_t hash = HashItems(trainingItems, trainingCount, HashBytes({}));
+	return HashItems(testingItems, testingCount, hash);
+}
+
+static const char* c_dataCacheSourceFileNames[4] =
+{
+	TDataSetInfo::c_trainingLabelFileName,
+	TDataSetInfo::c_trainingImageFileName,
+	TDataSetInfo::c_testingLabelFileName,
+	TDataSetInfo::c_testingImageFileName
+};
+
+bool GetDataCacheSource(const char* fileName, DataCacheSource& source)
+{
+	std::error_code error;
+	source.size = std::filesystem::file_size(fileName, error);
+	if (error)
+		return false;
+	source.modifiedTime = std::filesystem::last_write_time(fileName, error).time_since_epoch().count();
+	return !error;
+}
 
-	// Save out images
-	int lastPercent = -1;
-	std::vector<int> fileCounts(10, 0);
-	uint8_t* pixels = dataFiles.pixels;
-	for (uint32_t i = 0; i < dataFiles.imageCount; ++i)
+bool HashDataCacheSource(const char* fileName, DataCacheSource& source)
+{
+	MappedFile file;
+	if (!file.Open(fileName))
+		return false;
+	source.hash = HashBytes(file.Bytes());
+	return true;
+}
+
+bool HashDataCacheSources(DataCacheHeader& header)
+{
+	for (size_t sourceIndex = 0; sourceIndex < std::size(header.sources); ++sourceIndex)
 	{
-		int percent = int(100.0f * float(i) / float(dataFiles.imageCount - 1));
-		if (percent != lastPercent)
-		{
-			lastPercent = percent;
-			printf("\r%i%%", percent);
-		}
+		if (!HashDataCacheSource(DataSetPath(c_dataCacheSourceFileNames[sourceIndex]).c_str(), header.sources[sourceIndex]))
+			return false;
+	}
+	return true;
+}
 
-		char fileName[1024];
-		sprintf(fileName, "%s%i_%i.png", outDir, (int)dataFiles.labels[i], fileCounts[dataFiles.labels[i]]);
-		stbi_write_png(fileName, 28, 28, 1, pixels, 0);
-		pixels += 28 * 28;
-		fileCounts[dataFiles.labels[i]]++;
+// Fills out the header that a valid cache would have, except for the item counts, checksum and source hashes.
+// Returns false if the source files can't be found.
+bool MakeDataCacheHeader(DataCacheHeader& header)
+{
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, c_dataCacheMagic, sizeof(header.magic));
+	header.version = c_dataCacheVersion;
+	header.itemSize = sizeof(DataItem);
+	header.imageWidth = c_imageWidth;
+	header.imageHeight = c_imageHeight;
+	header.numClasses = c_numClasses;
+	header.pixelType = (uint32_t)IDXFile::Type::Float;
+	header.pixelScale = 1.0f / 255.0f;
+	header.hasBiasTerm = 1;
+
+	for (size_t sourceIndex = 0; sourceIndex < std::size(header.sources); ++sourceIndex)
+	{
+		if (!GetDataCacheSource(DataSetPath(c_dataCacheSourceFileNames[sourceIndex]).c_str(), header.sources[sourceIndex]))
+			return false;
 	}
-	printf("\r100%%\n");
+	return true;
 }
 
-void ExtractMNISTData(DataSet& trainingData, DataSet& testingData)
+// Reads just the header, so that a stale cache is found without mapping the whole file
+bool ReadDataCacheHeader(const char* fileName, DataCacheHeader& header)
+{
+	FILE* file = nullptr;
+	fopen_s(&file, fileName, "rb");
+	if (!file)
+		return false;
+	bool success = fread(&header, sizeof(header), 1, file) == 1;
+	fclose(file);
+	return success;
+}
+
+// Overwrites the header of an existing cache in place
+void WriteDataCacheHeader(const char* fileName, const DataCacheHeader& header)
+{
+	FILE* file = nullptr;
+	fopen_s(&file, fileName, "r+b");
+	if (!file)
+		return;
+	fwrite(&header, sizeof(header), 1, file);
+	fclose(file);
+}
+
+bool LoadDataCache(const DataCacheHeader& expectedHeader, DataSet& trainingData, DataSet& testingData)
 {
-	DataFiles training = LoadLabelAndDataFile("../Data/mnist/train-labels.idx1-ubyte", "../Data/mnist/train-images.idx3-ubyte");
-	DataFiles testing = LoadLabelAndDataFile("../Data/mnist/t10k-labels.idx1-ubyte", "../Data/mnist/t10k-images.idx3-ubyte");
+	std::string cacheFileName = DataSetPath(c_dataCacheFileName);
+	DataCacheHeader header;
+	if (!ReadDataCacheHeader(cacheFileName.c_str(), header))
+		return false;
+
+	// Everything except the counts, checksum and sources has to match what we expect
+	DataCacheHeader compareHeader = header;
+	compareHeader.trainingCount = expectedHeader.trainingCount;
+	compareHeader.testingCount = expectedHeader.testingCount;
+	compareHeader.checksum = expectedHeader.checksum;
+	memcpy(compareHeader.sources, expectedHeader.sources, sizeof(compareHeader.sources));
+	if (memcmp(&compareHeader, &expectedHeader, sizeof(DataCacheHeader)) != 0)
+		return false;
 
-	// extract the mnist data to PNGs, but only if it isn't already extracted
+	// A source file that changed size has changed. One that only has a new modification time may have just been copied or touched,
+	// so those are hashed to see if the contents changed. If they didn't, the new times are written to the header, so they aren't hashed again.
+	bool sourceTimesMatch = true;
+	for (size_t sourceIndex = 0; sourceIndex < std::size(header.sources); ++sourceIndex)
+	{
+		if (header.sources[sourceIndex].size != expectedHeader.sources[sourceIndex].size)
+			return false;
+		sourceTimesMatch = sourceTimesMatch && header.sources[sourceIndex].modifiedTime == expectedHeader.sources[sourceIndex].modifiedTime;
+	}
+	if (!sourceTimesMatch)
 	{
-		FILE* file = nullptr;
-		fopen_s(&file, "../Data/Testing/0_0.png", "rb");
-		if (file)
+		DataCacheHeader sourceHeader = expectedHeader;
+		if (!HashDataCacheSources(sourceHeader))
+			return false;
+		for (size_t sourceIndex = 0; sourceIndex < std::size(header.sources); ++sourceIndex)
 		{
-			fclose(file);
+			if (header.sources[sourceIndex].hash != sourceHeader.sources[sourceIndex].hash)
+				return false;
 		}
-		else
-		{
-			// Extract the data
-			_mkdir("../Data/Training/");
-			Convert(training, "../Data/Training/");
+		memcpy(header.sources, sourceHeader.sources, sizeof(header.sources));
+		WriteDataCacheHeader(cacheFileName.c_str(), header);
+	}
 
-			_mkdir("../Data/Testing/");
-			Convert(testing, "../Data/Testing/");
-		}
+	// The file has to be exactly the header and the items
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+	if (!file->Open(cacheFileName.c_str()) || file->Bytes().size() != sizeof(DataCacheHeader) + (header.trainingCount + header.testingCount) * sizeof(DataItem))
+		return false;
+
+	// The items after the header are 8 byte aligned in the mapping, since the header is a multiple of 8 bytes
+	const DataItem* trainingItems = (const DataItem*)(file->Bytes().data() + sizeof(DataCacheHeader));
+	const DataItem* testingItems = trainingItems + header.trainingCount;
+	if (HashItems(trainingItems, header.trainingCount, testingItems, header.testingCount) != header.checksum)
+		return false;
+
+	trainingData = DataSet(file, std::span<const DataItem>{ trainingItems, header.trainingCount });
+	testingData = DataSet(file, std::span<const DataItem>{ testingItems, header.testingCount });
+	return true;
+}
+
+// Writes to a temporary file which is renamed over the cache, so an interrupted write can't leave a partial cache behind
+void SaveDataCache(const DataCacheHeader& sourceHeader, const DataSet& trainingData, const DataSet& testingData)
+{
+	DataCacheHeader header = sourceHeader;
+	if (!HashDataCacheSources(header))
+		return;
+	header.trainingCount = trainingData.size();
+	header.testingCount = testingData.size();
+	header.checksum = HashItems(trainingData.data(), trainingData.size(), testingData.data(), testingData.size());
+
+	std::string cacheFileName = DataSetPath(c_dataCacheFileName);
+	std::string tempFileName = cacheFileName + ".tmp";
+	FILE* file = nullptr;
+	fopen_s(&file, tempFileName.c_str(), "wb");
+	if (!file)
+		return;
+
+	bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+	success = success && fwrite(trainingData.data(), sizeof(DataItem), trainingData.size(), file) == trainingData.size();
+	success = success && fwrite(testingData.data(), sizeof(DataItem), testingData.size(), file) == testingData.size();
+	success = (fclose(file) == 0) && success;
+
+	std::error_code error;
+	if (success)
+		std::filesystem::rename(tempFileName, cacheFileName, error);
+	if (!success || error)
+		std::filesystem::remove(tempFileName, error);
+}
+
+void ExtractMNISTData(DataSet& trainingData, DataSet& testingData)
+{
+#if CACHE_DATA_SET()
+	DataCacheHeader cacheHeader;
+	bool canCache = MakeDataCacheHeader(cacheHeader);
+	if (canCache && LoadDataCache(cacheHeader, trainingData, testingData))
+	{
+		trainingData.MakeNonZeroIndices();
+		return;
 	}
+#endif
+
+	DataFiles training, testing;
+	LoadMNISTData(training, testing);
 
 	// Fill out training data
-	trainingData.resize(training.imageCount);
+	std::vector<DataItem>& trainingItems = trainingData.MakeOwned();
+	trainingItems.resize(training.imageCount);
 	for (int imageIndex = 0; imageIndex < (int)training.imageCount; ++imageIndex)
 	{
-		DataItem& item = trainingData[imageIndex];
+		DataItem& item = trainingItems[imageIndex];
 		item.label = training.labels[imageIndex];
-		for (int pixelIndex = 0; pixelIndex < c_imageDims * c_imageDims; ++pixelIndex)
-			item.image[pixelIndex] = float(training.pixels[imageIndex * c_imageDims * c_imageDims + pixelIndex]) / 255.0f;
-		item.image[c_imageDims * c_imageDims] = 1.0f;
+		for (int pixelIndex = 0; pixelIndex < c_imagePixels; ++pixelIndex)
+			item.image[pixelIndex] = float(training.pixels[imageIndex * c_imagePixels + pixelIndex]) / 255.0f;
+		item.image[c_imagePixels] = 1.0f;
 	}
 
 	// fill out testing data
-	testingData.resize(testing.imageCount);
+	std::vector<DataItem>& testingItems = testingData.MakeOwned();
+	testingItems.resize(testing.imageCount);
 	for (int imageIndex = 0; imageIndex < (int)testing.imageCount; ++imageIndex)
 	{
-		DataItem& item = testingData[imageIndex];
+		DataItem& item = testingItems[imageIndex];
 		item.label = testing.labels[imageIndex];
-		for (int pixelIndex = 0; pixelIndex < c_imageDims * c_imageDims; ++pixelIndex)
-			item.image[pixelIndex] = float(testing.pixels[imageIndex * c_imageDims * c_imageDims + pixelIndex]) / 255.0f;
-		item.image[c_imageDims * c_imageDims] = 1.0f;
+		for (int pixelIndex = 0; pixelIndex < c_imagePixels; ++pixelIndex)
+			item.image[pixelIndex] = float(testing.pixels[imageIndex * c_imagePixels + pixelIndex]) / 255.0f;
+		item.image[c_imagePixels] = 1.0f;
+	}
+
+#if CACHE_DATA_SET()
+	if (canCache && !trainingData.empty() && !testingData.empty())
+		SaveDataCache(cacheHeader, trainingData, testingData);
+#endif
+
+	// Only the training data is used sparsely. The testing data is always evaluated with the whole image.
+	trainingData.MakeNonZeroIndices();
+}
+
+// The pixels are copied as is, with no conversion to float and no bias term.
+// Only the training files are read, since the testing data is always evaluated as a DataSet.
+void ExtractMNISTTrainingData(CompactDataSet& trainingData)
+{
+	DataFiles training = LoadLabelAndDataFile(TDataSetInfo::c_trainingLabelFileName, TDataSetInfo::c_trainingImageFileName);
+
+	trainingData.resize(training.imageCount);
+	for (int imageIndex = 0; imageIndex < (int)training.imageCount; ++imageIndex)
+	{
+		CompactDataItem& item = trainingData[imageIndex];
+		item.label = training.labels[imageIndex];
+		memcpy(item.pixels, &training.pixels[imageIndex * c_imagePixels], c_imagePixels);
 	}
-}
\ No newline at end of file
+}
@@ -7,15 +7,116 @@
 
 #include <vector>
 #include <array>
+#include <memory>
+#include <stdint.h>
 #include "Settings.h"
 #include <span>
+#include <string>
+
+class IDXFile;
+class MappedFile;
+
+// The sparse index lists are 16 bit, which limits the image size
+static_assert(c_imagePixels + 1 <= 65536, "Images are too large for the 16 bit non zero index lists");
+
+// Returns the path to a file in the TDataSetInfo directory
+inline std::string DataSetPath(const char* fileName)
+{
+	return std::string(TDataSetInfo::c_directory) + fileName;
+}
+
+// True if the files are a label file and an image file of the same number of items, with the image size and class count of TDataSetInfo
+bool IsValidDataSet(const IDXFile& labelFile, const IDXFile& imageFile);
 
 struct DataItem
 {
 	int label;
-	float image[c_imageDims * c_imageDims + 1]; // We have an extra 1.0 value for the input layer bias term
+	float image[c_imagePixels + 1]; // We have an extra 1.0 value for the input layer bias term
+};
+
+// Appends the indices of the non zero values in the item's image, including the bias term, to indices
+void MakeNonZeroIndices(const DataItem& item, std::vector<uint16_t>& indices);
+
+// The items of a data set. Usually they are owned, in a vector, but when they come from the data set cache they are served straight
+// out of the memory mapped cache file, which stays open as long as a DataSet is using it. That way loading the cache doesn't copy
+// 220MB of items into a second allocation.
+// The items are read only. To change them, call MakeOwned(), which copies mapped items into a vector first, and change them through that.
+//
+// Most pixels are 0.0, so the sparse versions of the neural network code only use the non zero ones. The data set can keep a list of
+// the indices of those for each item, which the values are read from the image at. The lists are kept apart from the items, one after
+// another in a single pool, so the code that uses the whole image doesn't pay for them in memory or bandwidth.
+class DataSet
+{
+public:
+	typedef DataItem value_type;
+
+	DataSet() = default;
+	DataSet(std::shared_ptr<const MappedFile> file, std::span<const DataItem> mappedItems) : m_file(std::move(file)), m_mappedItems(mappedItems) { }
+
+	bool IsMapped() const { return m_file != nullptr; }
+
+	size_t size() const { return Items().size(); }
+	bool empty() const { return Items().empty(); }
+
+	const DataItem* data() const { return Items().data(); }
+	const DataItem* begin() const { return data(); }
+	const DataItem* end() const { return data() + size(); }
+	const DataItem& operator[](size_t index) const { return Items()[index]; }
+
+	// Returns the items as a vector that can be changed. If the items are mapped, they are copied into the vector, and the mapping is let go.
+	// This also throws away the non zero index lists, so call MakeNonZeroIndices() again after changing the items, if they are needed.
+	// The vector stays valid until the DataSet is assigned to or destroyed.
+	std::vector<DataItem>& MakeOwned()
+	{
+		m_nonZeroOffsets.clear();
+		m_nonZeroIndices.clear();
+		if (m_file)
+		{
+			m_items.assign(m_mappedItems.begin(), m_mappedItems.end());
+			m_mappedItems = std::span<const DataItem>{};
+			m_file.reset();
+		}
+		return m_items;
+	}
+
+	// Makes the non zero index list of every item
+	void MakeNonZeroIndices();
+
+	// Returns the non zero index list of an item. Items that aren't in this data set, like the copies that the prefetcher makes,
+	// or any item if MakeNonZeroIndices() wasn't called, have their list made on the spot, in a buffer that is reused by the next call on this thread.
+	std::span<const uint16_t> NonZeroIndices(const DataItem& item) const;
+
+private:
+	std::span<const DataItem> Items() const { return m_file ? m_mappedItems : std::span<const DataItem>{ m_items }; }
+
+	std::vector<DataItem> m_items;
+
+	std::shared_ptr<const MappedFile> m_file;
+	std::span<const DataItem> m_mappedItems;
+
+	// Item i's list is m_nonZeroIndices[m_nonZeroOffsets[i]] to m_nonZeroIndices[m_nonZeroOffsets[i + 1]]
+	std::vector<uint32_t> m_nonZeroOffsets;
+	std::vector<uint16_t> m_nonZeroIndices;
+};
+
+// A compact version of DataItem, which keeps the 8 bit pixels from the MNIST files, instead of expanding them to floats.
+// There is no 1.0 for the bias term, the neural network code that takes these implies it.
+// The 60,000 training images take 47MB this way, instead of 190MB as floats, which is a lot less memory bandwidth when training.
+struct CompactDataItem
+{
+	int label;
+	uint8_t pixels[c_imagePixels];
+
+	std::span<const uint8_t, c_imagePixels> Pixels() const
+	{
+		return std::span<const uint8_t, c_imagePixels>{ pixels, c_imagePixels };
+	}
 };
 
-typedef std::vector<DataItem> DataSet;
+typedef std::vector<CompactDataItem> CompactDataSet;
+
+void ExtractMNISTData(DataSet& trainingData, DataSet& testingData);
+void ExtractMNISTTrainingData(CompactDataSet& trainingData);
 
-void ExtractMNISTData(DataSet& trainingData, DataSet& testingData);
\ No newline at end of file
+// Saves every training and testing image to Training/ and Testing/ in the data set directory, as <label>_<n>.png
+void ExtractMNISTPNGs();
\ No newline at end of file
@@ -5,78 +5,210 @@
 
 #pragma once
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <concepts>
+#include <string.h>
+#include <type_traits>
 #include <vector>
+#include "StackPoolAllocator.h"
 
 #define SHRINK_DUALS() true
 #define SHRINK_DUALS_ZERO_THRESHOLD() 0.0001f // This can be set to 0.0f
 
+// Where the duals of dual numbers are stored. DualNumber stores floats, and SparseDualNumber stores (index, value) pairs.
+// Each thread has its own arena, which is a bump allocator made of StackPoolAllocator chunks. Allocating is just moving an index,
+// and nothing is freed on its own. Instead the whole arena is reset at once, once per training item, which invalidates every
+// dual number made on that thread. A chunk is only added when the chunks so far run out, so after the first item has been through,
+// dual number math does no heap allocations at all.
+template <typename T>
+class DualArena
+{
+public:
+	static DualArena& ThreadInstance()
+	{
+		thread_local DualArena arena;
+		return arena;
+	}
+
+	void Reset()
+	{
+		for (size_t chunkIndex = 0; chunkIndex < m_chunks.size() && chunkIndex <= m_currentChunk; ++chunkIndex)
+			m_chunks[chunkIndex].Reset();
+		m_currentChunk = 0;
+	}
+
+	// count must be greater than 0
+	T* Allocate(size_t count)
+	{
+		// Move on to the next chunk that has room, adding one if there isn't one
+		while (m_currentChunk < m_chunks.size() && m_chunks[m_currentChunk].Remaining() < count)
+			m_currentChunk++;
+		if (m_currentChunk == m_chunks.size())
+			m_chunks.emplace_back(std::max(count, c_chunkSize));
+
+		return m_chunks[m_currentChunk].Allocate(count, false).data();
+	}
+
+private:
+	static constexpr size_t c_chunkSize = 1024 * 1024; // In items
+
+	// When this grows, the chunks are moved, which keeps their storage where it is, so pointers into them stay valid
+	std::vector<StackPoolAllocator<T>> m_chunks;
+	size_t m_currentChunk = 0;
+};
+
+using DualNumberArena = DualArena<float>;
+
+struct DualNumber;
+
+// Anything that can be read like a DualNumber: a real part, and a dual part for every dual index, which is 0 outside of
+// [DualIndexMin(), DualIndexMax()]. That is DualNumber itself, and the expressions made by the operators further down.
+// References() says whether the value reads from a given DualNumber, so that it can be evaluated into that number in place.
+template <typename T>
+concept DualExpression = requires(const T& e, int index, const DualNumber& d)
+{
+	{ e.Real() } -> std::convertible_to<float>;
+	{ e.Dual(index) } -> std::convertible_to<float>;
+	{ e.DualIndexMin() } -> std::convertible_to<int>;
+	{ e.DualIndexMax() } -> std::convertible_to<int>;
+	{ e.References(d) } -> std::convertible_to<bool>;
+};
+
+// The duals are a dense array for the range of dual indices [m_dualIndexMin, m_dualIndexMax], stored in the thread's DualNumberArena.
+// Copies get their own storage from the arena, and moves take the storage of the number they are moved from.
+//
+// The operators don't do any math on the duals. They return expressions, and the duals are only calculated when an expression is
+// assigned to a DualNumber, in a single loop over the dual indices, straight into the duals of the number being assigned to.
+// So ret += A * B, or a sigmoid, or a lerp, doesn't make any arrays of duals for the parts of the expression.
+//
+// An expression holds references to the DualNumbers in it, so don't keep one around in an auto variable past the end of the statement
+// it is made in, unless the DualNumbers in it outlive it.
 struct DualNumber
 {
 	DualNumber()
 	{
-		m_real = 0.0f;
-		m_dualIndexMin = INT_MAX;
-		m_dualIndexMax = INT_MIN;
 	}
 
 	explicit DualNumber(float f)
 	{
 		m_real = f;
-		m_dualIndexMin = INT_MAX;
-		m_dualIndexMax = INT_MIN;
+	}
+
+	DualNumber(const DualNumber& d)
+	{
+		m_real = d.m_real;
+		CopyDuals(d);
+	}
+
+	DualNumber(DualNumber&& d) noexcept
+	{
+		m_real = d.m_real;
+		TakeDuals(d);
+	}
+
+	template <DualExpression E>
+	DualNumber(const E& e)
+	{
+		m_real = e.Real();
+		AssignDuals(e);
+	}
+
+	DualNumber& operator = (const DualNumber& d)
+	{
+		if (this != &d)
+		{
+			m_real = d.m_real;
+			CopyDuals(d);
+		}
+		return *this;
+	}
+
+	DualNumber& operator = (DualNumber&& d) noexcept
+	{
+		if (this != &d)
+		{
+			m_real = d.m_real;
+			TakeDuals(d);
+		}
+		return *this;
+	}
+
+	template <DualExpression E>
+	DualNumber& operator = (const E& e)
+	{
+		// The expression may read this number, so the real part is read before anything is written
+		float real = e.Real();
+		AssignDuals(e);
+		m_real = real;
+		return *this;
 	}
 
 	void Reset()
 	{
 		m_real = 0.0f;
-		m_dualIndexMin = INT_MAX;
-		m_dualIndexMax = INT_MIN;
-		m_dual.resize(0);
+		EmptyDuals();
 	}
 
-	// Makes sure the duals are able to handle this range of dual indices for writing
+	// Makes sure the duals are able to handle this range of dual indices for writing.
+	// Duals that are added to the range are 0.
 	void PrepareDuals(int newDualIndexMin, int newDualIndexMax)
 	{
 		// if the range is empty, empty the duals
 		if (newDualIndexMax < newDualIndexMin)
 		{
-			m_dualIndexMin = INT_MAX;
-			m_dualIndexMax = INT_MIN;
-			m_dual.resize(0);
+			EmptyDuals();
 		}
 		// If the duals are empty, allocate
 		else if (DualsEmpty())
 		{
-			m_dualIndexMin = (int)newDualIndexMin;
-			m_dualIndexMax = (int)newDualIndexMax;
-			m_dual.resize(m_dualIndexMax - m_dualIndexMin + 1, 0.0f);
+			m_dualIndexMin = newDualIndexMin;
+			m_dualIndexMax = newDualIndexMax;
+			m_dualCapacity = m_dualIndexMax - m_dualIndexMin + 1;
+			m_dual = DualNumberArena::ThreadInstance().Allocate(m_dualCapacity);
+			std::fill(m_dual, m_dual + m_dualCapacity, 0.0f);
 		}
-		// else if the duals don't already encompass this range, make sure they do, via a resize and a copy
+		// else if the duals don't already encompass this range, make sure they do
 		else if (newDualIndexMin < m_dualIndexMin || newDualIndexMax > m_dualIndexMax)
 		{
 			// Make a union of the new range and the old
 			newDualIndexMin = std::min(newDualIndexMin, m_dualIndexMin);
 			newDualIndexMax = std::max(newDualIndexMax, m_dualIndexMax);
+			int oldValuesCount = m_dualIndexMax - m_dualIndexMin + 1;
+			int newValuesCount = newDualIndexMax - newDualIndexMin + 1;
 
-			// allocate larger storage for the new dual values
-			std::vector<float> newDual(newDualIndexMax - newDualIndexMin + 1, 0.0f);
+			// If it only grows upwards, and there is room, grow into the unused storage after the duals
+			if (newDualIndexMin == m_dualIndexMin && newValuesCount <= m_dualCapacity)
+			{
+				std::fill(m_dual + oldValuesCount, m_dual + newValuesCount, 0.0f);
+			}
+			// Otherwise, move to larger storage, with room to grow into
+			else
+			{
+				int newCapacity = std::max(newValuesCount, 2 * oldValuesCount);
+				float* newDual = DualNumberArena::ThreadInstance().Allocate(newCapacity);
 
-			// copy the old values into the new area
-			int oldValuesCount = m_dualIndexMax - m_dualIndexMin + 1;
-			memcpy(&newDual[m_dualIndexMin - newDualIndexMin], &m_dual[0], sizeof(float) * oldValuesCount);
+				// copy the old values into the new area, with zeros around them
+				int oldValuesOffset = m_dualIndexMin - newDualIndexMin;
+				std::fill(newDual, newDual + oldValuesOffset, 0.0f);
+				memcpy(&newDual[oldValuesOffset], m_dual, sizeof(float) * oldValuesCount);
+				std::fill(newDual + oldValuesOffset + oldValuesCount, newDual + newValuesCount, 0.0f);
 
-			// get rid of the old storage
-			std::swap(m_dual, newDual);
+				m_dual = newDual;
+				m_dualCapacity = newCapacity;
+			}
 
 			// update min and max
-			m_dualIndexMin = (int)newDualIndexMin;
-			m_dualIndexMax = (int)newDualIndexMax;
+			m_dualIndexMin = newDualIndexMin;
+			m_dualIndexMax = newDualIndexMax;
 		}
 
 		// otherwise, everything is ok as is!
 	}
 
 	// Shrinks the duals array to this size. Assumes you already made sure it's only throwing away zeros.
+	// This doesn't copy anything, it just moves the start of the duals forward, and the end back.
 	void ShrinkDuals(int newDualIndexMin, int newDualIndexMax)
 	{
 		// The range passed in should be a subset of the old range. Enforce that
@@ -90,24 +222,16 @@ struct DualNumber
 		// empty
 		if (newDualIndexMax < newDualIndexMin)
 		{
-			m_dualIndexMin = INT_MAX;
-			m_dualIndexMax = INT_MIN;
-			m_dual.resize(0);
+			EmptyDuals();
 			return;
 		}
 
-		// allocate storage for the new dual values
-		std::vector<float> newDual(newDualIndexMax - newDualIndexMin + 1, 0.0f);
-
-		// copy the old values into the new area
-		memcpy(&newDual[0], &m_dual[newDualIndexMin - m_dualIndexMin], sizeof(float) * newDual.size());
-
-		// get rid of the old storage
-		std::swap(m_dual, newDual);
+		m_dual += newDualIndexMin - m_dualIndexMin;
+		m_dualCapacity -= newDualIndexMin - m_dualIndexMin;
 
 		// update min and max
-		m_dualIndexMin = (int)newDualIndexMin;
-		m_dualIndexMax = (int)newDualIndexMax;
+		m_dualIndexMin = newDualIndexMin;
+		m_dualIndexMax = newDualIndexMax;
 	}
 
 	void SetDualValue(int index, float f)
@@ -121,8 +245,8 @@ struct DualNumber
 
 	float GetDualValue(int index) const
 	{
-		// Zero where we don't have any data
-		if (DualsEmpty() || index < m_dualIndexMin || index > m_dualIndexMax)
+		// Zero where we don't have any data. An empty range has a min above its max, so nothing is in it.
+		if (index < m_dualIndexMin || index > m_dualIndexMax)
 			return 0.0f;
 
 		return m_dual[index - m_dualIndexMin];
@@ -133,44 +257,72 @@ struct DualNumber
 		return m_dualIndexMax < 0;
 	}
 
-	template <typename LAMBDA>
-	static inline void ForEachDual(const DualNumber& A, const DualNumber& B, DualNumber& C, const LAMBDA& lambda)
-	{
-		// Run the foreach on the union of the duals of A and B
-		int minIndex = std::min(A.m_dualIndexMin, B.m_dualIndexMin);
-		int maxIndex = std::max(A.m_dualIndexMax, B.m_dualIndexMax);
-		C.PrepareDuals(minIndex, maxIndex);
+	// The DualExpression interface
+	float Real() const { return m_real; }
+	float Dual(int index) const { return GetDualValue(index); }
+	int DualIndexMin() const { return m_dualIndexMin; }
+	int DualIndexMax() const { return m_dualIndexMax; }
+	bool References(const DualNumber& d) const { return this == &d; }
 
-		#if SHRINK_DUALS()
-			int minNonZero = INT_MAX;
-			int maxNonZero = INT_MIN;
-		#endif
+	float m_real = 0.0f;
+	float* m_dual = nullptr; // In the thread's DualNumberArena. m_dual[0] is the dual of m_dualIndexMin.
+	int m_dualIndexMin = INT_MAX;
+	int m_dualIndexMax = INT_MIN;
+	int m_dualCapacity = 0; // How many floats there is room for at m_dual, which can be more than the range has in it
 
-		for (int i = minIndex; i <= maxIndex; ++i)
-		{
-			float& resultDual = C.m_dual[i - minIndex];
-			lambda(A.m_real, A.GetDualValue(i), B.m_real, B.GetDualValue(i), resultDual);
+private:
+	void EmptyDuals()
+	{
+		m_dual = nullptr;
+		m_dualIndexMin = INT_MAX;
+		m_dualIndexMax = INT_MIN;
+		m_dualCapacity = 0;
+	}
 
-			#if SHRINK_DUALS()
-			if (std::abs(resultDual) > SHRINK_DUALS_ZERO_THRESHOLD())
-			{
-				minNonZero = std::min(minNonZero, i);
-				maxNonZero = std::max(maxNonZero, i);
-			}
-			#endif
-		}
+	void CopyDuals(const DualNumber& d)
+	{
+		EmptyDuals();
+		if (d.DualsEmpty())
+			return;
 
-		#if SHRINK_DUALS()
-		C.ShrinkDuals(minNonZero, maxNonZero);
-		#endif
+		m_dualIndexMin = d.m_dualIndexMin;
+		m_dualIndexMax = d.m_dualIndexMax;
+		m_dualCapacity = m_dualIndexMax - m_dualIndexMin + 1;
+		m_dual = DualNumberArena::ThreadInstance().Allocate(m_dualCapacity);
+		memcpy(m_dual, d.m_dual, sizeof(float) * m_dualCapacity);
 	}
 
-	template <typename LAMBDA>
-	static inline void ForEachDual(const DualNumber& A, DualNumber& B, const LAMBDA& lambda)
+	void TakeDuals(DualNumber& d)
 	{
-		int minIndex = A.m_dualIndexMin;
-		int maxIndex = A.m_dualIndexMax;
-		B.PrepareDuals(minIndex, maxIndex);
+		m_dual = d.m_dual;
+		m_dualIndexMin = d.m_dualIndexMin;
+		m_dualIndexMax = d.m_dualIndexMax;
+		m_dualCapacity = d.m_dualCapacity;
+		d.EmptyDuals();
+	}
+
+	// Sets the duals to the duals of the expression, in one loop over its range of dual indices.
+	// The dual at an index only depends on the duals at the same index, so if the expression reads this number, it's fine to write
+	// over the duals as they are read. That is done when the result fits in the storage this number already has. Otherwise the
+	// result goes in new storage, and the old storage is still there to be read from until the loop is done.
+	template <DualExpression E>
+	void AssignDuals(const E& e)
+	{
+		int minIndex = e.DualIndexMin();
+		int maxIndex = e.DualIndexMax();
+		if (maxIndex < minIndex)
+		{
+			EmptyDuals();
+			return;
+		}
+
+		float* dual = m_dual;
+		int capacity = m_dualCapacity;
+		if (!e.References(*this) || minIndex != m_dualIndexMin || maxIndex - minIndex >= m_dualCapacity)
+		{
+			capacity = maxIndex - minIndex + 1;
+			dual = DualNumberArena::ThreadInstance().Allocate(capacity);
+		}
 
 		#if SHRINK_DUALS()
 			int minNonZero = INT_MAX;
@@ -179,8 +331,8 @@ struct DualNumber
 
 		for (int i = minIndex; i <= maxIndex; ++i)
 		{
-			float& resultDual = B.m_dual[i - minIndex];
-			lambda(A.m_real, A.GetDualValue(i), resultDual);
+			float& resultDual = dual[i - minIndex];
+			resultDual = e.Dual(i);
 
 			#if SHRINK_DUALS()
 			if (std::abs(resultDual) > SHRINK_DUALS_ZERO_THRESHOLD())
@@ -191,199 +343,250 @@ struct DualNumber
 			#endif
 		}
 
+		m_dual = dual;
+		m_dualIndexMin = minIndex;
+		m_dualIndexMax = maxIndex;
+		m_dualCapacity = capacity;
+
 		#if SHRINK_DUALS()
-		B.ShrinkDuals(minNonZero, maxNonZero);
+		ShrinkDuals(minNonZero, maxNonZero);
 		#endif
 	}
 
-	float m_real = 0.0f;
-	std::vector<float> m_dual;  // A vector to not bust the stack! Also allows it to be sparse.
-	int m_dualIndexMin = INT_MAX;
-	int m_dualIndexMax = INT_MIN;
-
+public:
 	//==================================================
-	// Unary ops
+	// A (op =) B
+	// += only loops over the duals of B, since the other duals of A don't change. That makes a dot product of dual weights with
+	// float activations, where each B has one dual, linear in the number of weights, instead of quadratic.
+	// The other operators assign the expression A (op) B, which is done in place when there is room.
 	//==================================================
 
-	inline DualNumber operator - () const
+	template <DualExpression E>
+	inline DualNumber& operator += (const E& e)
 	{
-		DualNumber ret = *this;
-		ret.m_real = -m_real;
-		for (float& f : ret.m_dual)
-			f = -f;
-		return ret;
-	}
+		// The expression may read this number, so the real part is read before anything is written
+		float real = e.Real();
 
-	//==================================================
-	// A (op) B
-	//==================================================
+		int minIndex = e.DualIndexMin();
+		int maxIndex = e.DualIndexMax();
+		if (minIndex <= maxIndex)
+		{
+			int oldDualIndexMin = m_dualIndexMin;
+			int oldDualIndexMax = m_dualIndexMax;
+			PrepareDuals(minIndex, maxIndex);
 
-	inline DualNumber operator - (const DualNumber& d) const
-	{
-		DualNumber ret;
-		ret.m_real = m_real - d.m_real;
-		ForEachDual(*this, d, ret,
-			[](float AReal, float ADual, float BReal, float BDual, float& retDual)
-			{
-				retDual = ADual - BDual;
-			}
-		);
-		return ret;
-	}
+			#if SHRINK_DUALS()
+				int minNonZero = INT_MAX;
+				int maxNonZero = INT_MIN;
+			#endif
 
-	inline DualNumber operator + (const DualNumber& d) const
-	{
-		DualNumber ret;
-		ret.m_real = m_real + d.m_real;
-		ForEachDual(*this, d, ret,
-			[](float AReal, float ADual, float BReal, float BDual, float& retDual)
+			for (int i = minIndex; i <= maxIndex; ++i)
 			{
-				retDual = ADual + BDual;
+				float& resultDual = m_dual[i - m_dualIndexMin];
+				resultDual += e.Dual(i);
+
+				#if SHRINK_DUALS()
+				if (std::abs(resultDual) > SHRINK_DUALS_ZERO_THRESHOLD())
+				{
+					minNonZero = std::min(minNonZero, i);
+					maxNonZero = std::max(maxNonZero, i);
+				}
+				#endif
 			}
-		);
-		return ret;
-	}
 
-	inline DualNumber operator * (const DualNumber& d) const
-	{
-		DualNumber ret;
-		ret.m_real = m_real * d.m_real;
-		ForEachDual(*this, d, ret,
-			[](float AReal, float ADual, float BReal, float BDual, float& retDual)
-			{
-				retDual = (AReal * BDual) + (ADual * BReal);
-			}
-		);
-		return ret;
+			#if SHRINK_DUALS()
+			// The duals of the old range that are outside of the loop didn't change, so if the old range reaches past the loop,
+			// its end is still where the non zero duals end. An empty old range is INT_MAX to INT_MIN, so never reaches past it.
+			bool oldReachesBelow = oldDualIndexMin < minIndex;
+			bool oldReachesAbove = oldDualIndexMax > maxIndex;
+			if (oldReachesBelow)
+				minNonZero = oldDualIndexMin;
+			else if (minNonZero == INT_MAX && oldReachesAbove)
+				minNonZero = maxIndex + 1;
+			if (oldReachesAbove)
+				maxNonZero = oldDualIndexMax;
+			else if (maxNonZero == INT_MIN && oldReachesBelow)
+				maxNonZero = minIndex - 1;
+			ShrinkDuals(minNonZero, maxNonZero);
+			#endif
+		}
+
+		m_real = m_real + real;
+		return *this;
 	}
 
-	inline DualNumber operator / (const DualNumber& d) const
+	template <DualExpression E>
+	inline DualNumber& operator -= (const E& e)
 	{
-		DualNumber ret;
-		ret.m_real = m_real / d.m_real;
-		ForEachDual(*this, d, ret,
-			[](float AReal, float ADual, float BReal, float BDual, float& retDual)
-			{
-				retDual = (ADual * BReal - AReal * BDual) / (BReal * BReal);
-			}
-		);
-		return ret;
+		return *this += -e;
 	}
-	
-	//==================================================
-	// A (op =) B
-	//==================================================
 
-	inline DualNumber& operator += (const DualNumber& d)
+	template <DualExpression E>
+	inline DualNumber& operator *= (const E& e)
 	{
-		(*this) = (*this) + d;
-		return *this;
+		return *this = *this * e;
 	}
 
-	inline DualNumber& operator -= (const DualNumber& d)
+	template <DualExpression E>
+	inline DualNumber& operator /= (const E& e)
 	{
-		(*this) = (*this) - d;
-		return *this;
+		return *this = *this / e;
 	}
+};
 
-	inline DualNumber& operator *= (const DualNumber& d)
+//==================================================
+// Expressions
+// Every operation's dual part is a linear combination of the dual parts of its arguments, with weights that are the partial
+// derivatives, which only depend on the real parts. So there are only two kinds of expression: one argument and one weight, and
+// two arguments and two weights. The real part and the weights are calculated when the expression is made, and the duals are
+// calculated one index at a time when the expression is assigned to a DualNumber.
+//==================================================
+
+// DualNumbers in an expression are held by reference, and other expressions by value, since those are temporaries.
+template <typename T>
+using DualOperand = std::conditional_t<std::is_same_v<T, DualNumber>, const DualNumber&, const T>;
+
+// f(A), where the dual part is dual(A) * f'(A)
+template <DualExpression A>
+struct DualUnaryExpression
+{
+	DualUnaryExpression(const A& a, float real, float scale)
+		: m_a(a)
+		, m_real(real)
+		, m_scale(scale)
 	{
-		(*this) = (*this) * d;
-		return *this;
 	}
 
-	inline DualNumber& operator /= (const DualNumber& d)
+	float Real() const { return m_real; }
+	float Dual(int index) const { return m_a.Dual(index) * m_scale; }
+	int DualIndexMin() const { return m_a.DualIndexMin(); }
+	int DualIndexMax() const { return m_a.DualIndexMax(); }
+	bool References(const DualNumber& d) const { return m_a.References(d); }
+
+	DualOperand<A> m_a;
+	float m_real;
+	float m_scale;
+};
+
+// f(A, B), where the dual part is dual(A) * df/dA + dual(B) * df/dB, over the union of the dual index ranges of A and B
+template <DualExpression A, DualExpression B>
+struct DualBinaryExpression
+{
+	DualBinaryExpression(const A& a, const B& b, float real, float scaleA, float scaleB)
+		: m_a(a)
+		, m_b(b)
+		, m_real(real)
+		, m_scaleA(scaleA)
+		, m_scaleB(scaleB)
 	{
-		(*this) = (*this) / d;
-		return *this;
 	}
+
+	float Real() const { return m_real; }
+	float Dual(int index) const { return m_a.Dual(index) * m_scaleA + m_b.Dual(index) * m_scaleB; }
+	int DualIndexMin() const { return std::min(m_a.DualIndexMin(), m_b.DualIndexMin()); }
+	int DualIndexMax() const { return std::max(m_a.DualIndexMax(), m_b.DualIndexMax()); }
+	bool References(const DualNumber& d) const { return m_a.References(d) || m_b.References(d); }
+
+	DualOperand<A> m_a;
+	DualOperand<B> m_b;
+	float m_real;
+	float m_scaleA;
+	float m_scaleB;
 };
 
+//==================================================
+// Unary ops
+//==================================================
+
+template <DualExpression A>
+inline DualUnaryExpression<A> operator - (const A& a)
+{
+	return DualUnaryExpression<A>(a, -a.Real(), -1.0f);
+}
+
+//==================================================
+// A (op) B
+//==================================================
+
+template <DualExpression A, DualExpression B>
+inline DualBinaryExpression<A, B> operator + (const A& a, const B& b)
+{
+	return DualBinaryExpression<A, B>(a, b, a.Real() + b.Real(), 1.0f, 1.0f);
+}
+
+template <DualExpression A, DualExpression B>
+inline DualBinaryExpression<A, B> operator - (const A& a, const B& b)
+{
+	return DualBinaryExpression<A, B>(a, b, a.Real() - b.Real(), 1.0f, -1.0f);
+}
+
+template <DualExpression A, DualExpression B>
+inline DualBinaryExpression<A, B> operator * (const A& a, const B& b)
+{
+	return DualBinaryExpression<A, B>(a, b, a.Real() * b.Real(), b.Real(), a.Real());
+}
+
+template <DualExpression A, DualExpression B>
+inline DualBinaryExpression<A, B> operator / (const A& a, const B& b)
+{
+	// d(A/B) = dA / B - A * dB / B^2
+	float BReal = b.Real();
+	return DualBinaryExpression<A, B>(a, b, a.Real() / BReal, 1.0f / BReal, -a.Real() / (BReal * BReal));
+}
+
 //==================================================
 // float (op) DualNumber
 // DualNumber (op) float
+// A float has a dual part of zero, so these only have one argument.
 //==================================================
 
-inline DualNumber operator + (float f, const DualNumber& d)
+template <DualExpression A>
+inline DualUnaryExpression<A> operator + (float f, const A& a)
 {
-	DualNumber ret = d;
-	ret.m_real = f + ret.m_real;
-	return ret;
+	return DualUnaryExpression<A>(a, f + a.Real(), 1.0f);
 }
 
-inline DualNumber operator - (float f, const DualNumber& d)
+template <DualExpression A>
+inline DualUnaryExpression<A> operator - (float f, const A& a)
 {
-	DualNumber ret = d;
-	ret.m_real = f - ret.m_real;
-	return ret;
+	return DualUnaryExpression<A>(a, f - a.Real(), -1.0f);
 }
 
-inline DualNumber operator * (float f, const DualNumber& d)
+template <DualExpression A>
+inline DualUnaryExpression<A> operator * (float f, const A& a)
 {
-	DualNumber ret = d;
-	ret.m_real = f * ret.m_real;
-	DualNumber::ForEachDual(d, ret,
-		[f](float AReal, float ADual, float& retDual)
-		{
-			retDual = ADual * f;
-		}
-	);
-	return ret;
+	return DualUnaryExpression<A>(a, f * a.Real(), f);
 }
 
-inline DualNumber operator / (float f, const DualNumber& d)
+template <DualExpression A>
+inline DualUnaryExpression<A> operator / (float f, const A& a)
 {
-	// The DualNumber struct's division operation, but f has a dual part of zero.
-	DualNumber ret;
-	ret.m_real = f / d.m_real;
-	DualNumber::ForEachDual(d, ret,
-		[f](float AReal, float ADual, float& retDual)
-		{
-			retDual = (-f * ADual) / (AReal * AReal);
-		}
-	);
-	return ret;
+	float AReal = a.Real();
+	return DualUnaryExpression<A>(a, f / AReal, -f / (AReal * AReal));
 }
 
-inline DualNumber operator + (const DualNumber& d, float f)
+template <DualExpression A>
+inline DualUnaryExpression<A> operator + (const A& a, float f)
 {
-	DualNumber ret = d;
-	ret.m_real = ret.m_real + f;
-	return ret;
+	return DualUnaryExpression<A>(a, a.Real() + f, 1.0f);
 }
 
-inline DualNumber operator - (const DualNumber& d, float f)
+template <DualExpression A>
+inline DualUnaryExpression<A> operator - (const A& a, float f)
 {
-	DualNumber ret = d;
-	ret.m_real = ret.m_real - f;
-	return ret;
+	return DualUnaryExpression<A>(a, a.Real() - f, 1.0f);
 }
 
-inline DualNumber operator * (const DualNumber& d, float f)
+template <DualExpression A>
+inline DualUnaryExpression<A> operator * (const A& a, float f)
 {
-	DualNumber ret = d;
-	ret.m_real = ret.m_real * f;
-	DualNumber::ForEachDual(d, ret,
-		[f](float AReal, float ADual, float& retDual)
-		{
-			retDual = ADual * f;
-		}
-	);
-	return ret;
+	return DualUnaryExpression<A>(a, a.Real() * f, f);
 }
 
-inline DualNumber operator / (const DualNumber& d, float f)
+template <DualExpression A>
+inline DualUnaryExpression<A> operator / (const A& a, float f)
 {
-	// The DualNumber struct's division operation, but f has a dual part of zero.
-	DualNumber ret;
-	ret.m_real = d.m_real / f;
-	DualNumber::ForEachDual(d, ret,
-		[f](float AReal, float ADual, float& retDual)
-		{
-			retDual = ADual / f;
-		}
-	);
-	return ret;
+	return DualUnaryExpression<A>(a, a.Real() / f, 1.0f / f);
 }
 
 //==================================================
@@ -392,17 +595,12 @@ inline DualNumber operator / (const DualNumber& d, float f)
 
 namespace std
 {
-	inline DualNumber exp(const DualNumber& d)
+	template <DualExpression A>
+	inline DualUnaryExpression<A> exp(const A& a)
 	{
-		DualNumber ret;
-		ret.m_real = exp(d.m_real);
-		DualNumber::ForEachDual(d, ret,
-			[](float AReal, float ADual, float& retDual)
-			{
-				retDual = ADual * std::exp(AReal);
-			}
-		);
-		return ret;
+		// The derivative of exp(x) is exp(x), so it is calculated once and used for the real part and the dual parts
+		float expReal = exp(a.Real());
+		return DualUnaryExpression<A>(a, expReal, expReal);
 	}
 };
 
@@ -0,0 +1,202 @@
+///////////////////////////////////////////////////////////////////////////////
+//             Machine Learning Introduction For Game Developers             //
+//         Copyright (c) 2023 Electronic Arts Inc. All rights reserved.      //
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cmath>
+#include <stddef.h>
+
+// A dual number with a fixed number of dual parts, K, stored in the number itself. Each of the K duals (lanes) is the derivative
+// with respect to a different variable.
+//
+// DualNumber gets the derivatives for every weight at once, in a sparse array that grows as it goes. This gets the derivatives for
+// K weights at a time instead, so to get the whole gradient, the network is evaluated once per chunk of K weights, with that chunk
+// being the weights that have a dual of 1. In exchange, the numbers are a fixed size with no allocations, every operation is the same
+// branchless loop over all K lanes, which the compiler vectorizes since K is known, and the chunks don't depend on each other, so
+// they can be done on different threads.
+template <size_t K>
+struct DualNumberN
+{
+	static_assert(K > 0 && K % 8 == 0, "K should be a multiple of 8, so the duals are a whole number of AVX registers");
+	static const size_t c_numLanes = K;
+
+	DualNumberN()
+	{
+	}
+
+	explicit DualNumberN(float f)
+	{
+		m_real = f;
+	}
+
+	// Returns f(x), given f and its derivative at the real part of x. By the chain rule, the duals are the duals of x times the derivative.
+	static DualNumberN ChainRule(const DualNumberN& x, float value, float derivative)
+	{
+		DualNumberN ret;
+		ret.m_real = value;
+		for (size_t i = 0; i < K; ++i)
+			ret.m_dual[i] = x.m_dual[i] * derivative;
+		return ret;
+	}
+
+	//==================================================
+	// Unary ops
+	//==================================================
+
+	inline DualNumberN operator - () const
+	{
+		return ChainRule(*this, -m_real, -1.0f);
+	}
+
+	//==================================================
+	// A (op) B
+	//==================================================
+
+	inline DualNumberN operator + (const DualNumberN& d) const
+	{
+		DualNumberN ret = *this;
+		ret += d;
+		return ret;
+	}
+
+	inline DualNumberN operator - (const DualNumberN& d) const
+	{
+		DualNumberN ret = *this;
+		ret -= d;
+		return ret;
+	}
+
+	inline DualNumberN operator * (const DualNumberN& d) const
+	{
+		DualNumberN ret = *this;
+		ret *= d;
+		return ret;
+	}
+
+	inline DualNumberN operator / (const DualNumberN& d) const
+	{
+		DualNumberN ret = *this;
+		ret /= d;
+		return ret;
+	}
+
+	//==================================================
+	// A (op =) B
+	// The duals read the real part of this number, so it is updated after the duals.
+	//==================================================
+
+	inline DualNumberN& operator += (const DualNumberN& d)
+	{
+		for (size_t i = 0; i < K; ++i)
+			m_dual[i] += d.m_dual[i];
+		m_real += d.m_real;
+		return *this;
+	}
+
+	inline DualNumberN& operator -= (const DualNumberN& d)
+	{
+		for (size_t i = 0; i < K; ++i)
+			m_dual[i] -= d.m_dual[i];
+		m_real -= d.m_real;
+		return *this;
+	}
+
+	inline DualNumberN& operator *= (const DualNumberN& d)
+	{
+		for (size_t i = 0; i < K; ++i)
+			m_dual[i] = m_real * d.m_dual[i] + m_dual[i] * d.m_real;
+		m_real *= d.m_real;
+		return *this;
+	}
+
+	inline DualNumberN& operator /= (const DualNumberN& d)
+	{
+		// d(A/B) = dA / B - A * dB / B^2
+		float scaleA = 1.0f / d.m_real;
+		float scaleB = -m_real / (d.m_real * d.m_real);
+		for (size_t i = 0; i < K; ++i)
+			m_dual[i] = m_dual[i] * scaleA + d.m_dual[i] * scaleB;
+		m_real /= d.m_real;
+		return *this;
+	}
+
+	float m_real = 0.0f;
+	alignas(32) float m_dual[K] = {};
+};
+
+template <typename T>
+constexpr bool c_isDualNumberN = false;
+
+template <size_t K>
+constexpr bool c_isDualNumberN<DualNumberN<K>> = true;
+
+//==================================================
+// float (op) DualNumberN
+// DualNumberN (op) float
+// A float has duals of zero, so these are all the chain rule on the DualNumberN.
+//==================================================
+
+template <size_t K>
+inline DualNumberN<K> operator + (float f, const DualNumberN<K>& d)
+{
+	return DualNumberN<K>::ChainRule(d, f + d.m_real, 1.0f);
+}
+
+template <size_t K>
+inline DualNumberN<K> operator - (float f, const DualNumberN<K>& d)
+{
+	return DualNumberN<K>::ChainRule(d, f - d.m_real, -1.0f);
+}
+
+template <size_t K>
+inline DualNumberN<K> operator * (float f, const DualNumberN<K>& d)
+{
+	return DualNumberN<K>::ChainRule(d, f * d.m_real, f);
+}
+
+template <size_t K>
+inline DualNumberN<K> operator / (float f, const DualNumberN<K>& d)
+{
+	return DualNumberN<K>::ChainRule(d, f / d.m_real, -f / (d.m_real * d.m_real));
+}
+
+template <size_t K>
+inline DualNumberN<K> operator + (const DualNumberN<K>& d, float f)
+{
+	return DualNumberN<K>::ChainRule(d, d.m_real + f, 1.0f);
+}
+
+template <size_t K>
+inline DualNumberN<K> operator - (const DualNumberN<K>& d, float f)
+{
+	return DualNumberN<K>::ChainRule(d, d.m_real - f, 1.0f);
+}
+
+template <size_t K>
+inline DualNumberN<K> operator * (const DualNumberN<K>& d, float f)
+{
+	return DualNumberN<K>::ChainRule(d, d.m_real * f, f);
+}
+
+template <size_t K>
+inline DualNumberN<K> operator / (const DualNumberN<K>& d, float f)
+{
+	return DualNumberN<K>::ChainRule(d, d.m_real / f, 1.0f / f);
+}
+
+//==================================================
+// std:: implementations
+//==================================================
+
+namespace std
+{
+	template <size_t K>
+	inline DualNumberN<K> exp(const DualNumberN<K>& d)
+	{
+		// The derivative of exp(x) is exp(x)
+		float expReal = exp(d.m_real);
+		return DualNumberN<K>::ChainRule(d, expReal, expReal);
+	}
+};
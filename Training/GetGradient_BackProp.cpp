@@ -5,8 +5,124 @@
 
 #include "Settings.h"
 #include "DataSet.h"
+#include "AlignedAllocator.h"
+
+#include <omp.h>
 
 std::span<const float, TNeuralNetwork::c_numWeights> GetGradient_Backprop(TNeuralNetwork& neuralNet, const DataItem& dataItem)
 {
 	return neuralNet.ForwardPassAndBackprop(dataItem.image, dataItem.label);
-}
\ No newline at end of file
+}
+
+void AccumulateGradient_Backprop(TNeuralNetwork& neuralNet, const DataItem& dataItem, std::span<float, TNeuralNetwork::c_numWeights> gradientSum)
+{
+	neuralNet.ForwardPassAndBackprop(dataItem.image, dataItem.label, gradientSum);
+}
+
+void AccumulateGradient_BackpropCompact(TNeuralNetwork& neuralNet, const CompactDataItem& dataItem, std::span<float, TNeuralNetwork::c_numWeights> gradientSum)
+{
+	neuralNet.ForwardPassAndBackprop(dataItem.Pixels(), dataItem.label, gradientSum);
+}
+
+void AccumulateGradient_BackpropSparse(TNeuralNetwork& neuralNet, const DataItem& dataItem, std::span<const uint16_t> nonZeroIndices, std::span<float, TNeuralNetwork::c_numWeights> gradientSum)
+{
+	neuralNet.ForwardPassAndBackpropSparse(dataItem.image, nonZeroIndices, dataItem.label, gradientSum);
+}
+
+float AccumulateGradient_BackpropWeighted(TNeuralNetwork& neuralNet, const DataItem& dataItem, float weight, std::span<float, TNeuralNetwork::c_numWeights> gradientSum)
+{
+	return neuralNet.ForwardPassAndBackprop(dataItem.image, dataItem.label, gradientSum, weight);
+}
+
+// Adds the summed gradient of the mini batch into gradientSum, using batched backprop.
+// The network's batched backprop is sized for c_miniBatchSize items, so larger batches are done c_miniBatchSize items at a time.
+static void AccumulateGradient_BackpropBatched(TNeuralNetwork& neuralNet, std::span<const DataItem* const> miniBatch, std::span<float, TNeuralNetwork::c_numWeights> gradientSum)
+{
+	for (size_t batchBegin = 0; batchBegin < miniBatch.size(); batchBegin += c_miniBatchSize)
+	{
+		size_t batchSize = std::min(c_miniBatchSize, miniBatch.size() - batchBegin);
+
+		// Gather the pointers to the images, and the labels, into arrays for the neural network
+		const float* inputs[c_miniBatchSize];
+		int labels[c_miniBatchSize];
+		for (size_t index = 0; index < batchSize; ++index)
+		{
+			inputs[index] = miniBatch[batchBegin + index]->image;
+			labels[index] = miniBatch[batchBegin + index]->label;
+		}
+
+		neuralNet.ForwardPassAndBackpropBatch<c_miniBatchSize>(
+			std::span<const float* const>{ inputs, batchSize },
+			std::span<const int>{ labels, batchSize },
+			gradientSum
+		);
+	}
+}
+
+std::span<const float, TNeuralNetwork::c_numWeights> GetGradient_BackpropBatched(TNeuralNetwork& neuralNet, std::span<const DataItem* const> miniBatch)
+{
+	thread_local std::vector<float> gradient(TNeuralNetwork::c_numWeights);
+	std::fill(gradient.begin(), gradient.end(), 0.0f);
+
+	std::span<float, TNeuralNetwork::c_numWeights> gradientSpan{ gradient.data(), TNeuralNetwork::c_numWeights };
+	AccumulateGradient_BackpropBatched(neuralNet, miniBatch, gradientSpan);
+	return gradientSpan;
+}
+
+std::span<const float, TNeuralNetwork::c_numWeights> GetGradient_BackpropParallel(TNeuralNetwork& neuralNet, std::span<const DataItem* const> miniBatch)
+{
+	// Each thread sums the gradient of its part of the mini batch into its own buffer.
+	// The buffers are cache line aligned so that threads don't slow each other down by writing to the same cache lines.
+	// They belong to the calling thread, and are kept between calls so that they are only allocated once.
+	// The worker threads have their own thread_local copies, so they get to the calling thread's buffers through a reference.
+	thread_local std::vector<AlignedVector<float>> callingThreadGradients;
+	std::vector<AlignedVector<float>>& threadGradients = callingThreadGradients;
+
+	#if MULTI_THREADED()
+	int numThreads = std::max(std::min(omp_get_max_threads(), (int)miniBatch.size()), 1);
+	#else
+	int numThreads = 1;
+	#endif
+
+	if (threadGradients.size() < (size_t)numThreads)
+		threadGradients.resize(numThreads, AlignedVector<float>(TNeuralNetwork::c_numWeights));
+
+	#if MULTI_THREADED()
+	#pragma omp parallel num_threads(numThreads)
+	#endif
+	{
+		int threadIndex = omp_get_thread_num();
+		int threadCount = omp_get_num_threads();
+
+		// Split the mini batch into equal sized pieces, one per thread.
+		// Zero this thread's gradient and sum the gradient of its part of the mini batch into it.
+		size_t batchBegin = miniBatch.size() * threadIndex / threadCount;
+		size_t batchEnd = miniBatch.size() * (threadIndex + 1) / threadCount;
+		std::span<float, TNeuralNetwork::c_numWeights> gradient{ threadGradients[threadIndex].data(), TNeuralNetwork::c_numWeights };
+		std::fill(gradient.begin(), gradient.end(), 0.0f);
+		AccumulateGradient_BackpropBatched(neuralNet, miniBatch.subspan(batchBegin, batchEnd - batchBegin), gradient);
+
+		// Once every thread is done, each thread adds up one slice of the weights across all of the buffers, into buffer 0.
+		// The slices are a whole number of cache lines, so no two threads write to the same cache line.
+		#pragma omp barrier
+		if (threadCount > 1)
+		{
+			static const size_t c_floatsPerCacheLine = 64 / sizeof(float);
+			size_t cacheLineCount = (TNeuralNetwork::c_numWeights + c_floatsPerCacheLine - 1) / c_floatsPerCacheLine;
+			size_t sliceBegin = std::min(cacheLineCount * threadIndex / threadCount * c_floatsPerCacheLine, TNeuralNetwork::c_numWeights);
+			size_t sliceEnd = std::min(cacheLineCount * (threadIndex + 1) / threadCount * c_floatsPerCacheLine, TNeuralNetwork::c_numWeights);
+
+			thread_local std::vector<const float*> slices;
+			slices.resize(threadCount - 1);
+			for (int otherThreadIndex = 1; otherThreadIndex < threadCount; ++otherThreadIndex)
+				slices[otherThreadIndex - 1] = &threadGradients[otherThreadIndex][sliceBegin];
+
+			thread_local std::vector<float> ones;
+			ones.resize(threadCount - 1, 1.0f);
+
+			GetSIMDKernels().AddScaledBatch(&threadGradients[0][sliceBegin], slices.data(), ones.data(), threadCount - 1, sliceEnd - sliceBegin);
+		}
+	}
+
+	return std::span<const float, TNeuralNetwork::c_numWeights>{ threadGradients[0].data(), TNeuralNetwork::c_numWeights };
+}
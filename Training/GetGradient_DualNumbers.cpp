@@ -10,12 +10,56 @@ std::span<const float, TNeuralNetwork::c_numWeights> GetGradient_DualNumbers(TNe
 {
 	static std::vector<float> gradient(TNeuralNetwork::c_numWeights);
 
+	// The dual numbers of the last item aren't used anymore, so their storage can be reused
+	DualNumberArena::ThreadInstance().Reset();
+
 	// Evaluate it and get the cost as a dual number
 	DualNumber cost = neuralNet.EvaluateOneHotCost<DualNumber>(dataItem.image, dataItem.label);
 
 	// extract the gradient
 	for (int i = 0; i < gradient.size(); ++i)
-		gradient[i] = -cost.GetDualValue(i);
+		gradient[i] = cost.GetDualValue(i);
+
+	return std::span<const float, TNeuralNetwork::c_numWeights>{ gradient.data(), TNeuralNetwork::c_numWeights };
+}
+
+std::span<const float, TNeuralNetwork::c_numWeights> GetGradient_DualNumbersChunked(TNeuralNetwork& neuralNet, const DataItem& dataItem)
+{
+	static std::vector<float> gradient(TNeuralNetwork::c_numWeights);
+
+	// Each pass gets the derivatives of the next chunk of weights, by giving those weights the duals, and evaluating the network.
+	// The passes don't share anything, so they are spread across threads.
+	const int chunkCount = int((TNeuralNetwork::c_numWeights + TDualNumberN::c_numLanes - 1) / TDualNumberN::c_numLanes);
+	#if MULTI_THREADED()
+	#pragma omp parallel for schedule(static)
+	#endif
+	for (int chunkIndex = 0; chunkIndex < chunkCount; ++chunkIndex)
+	{
+		size_t firstWeight = size_t(chunkIndex) * TDualNumberN::c_numLanes;
+		size_t weightCount = std::min(TDualNumberN::c_numLanes, TNeuralNetwork::c_numWeights - firstWeight);
+
+		TDualNumberN cost = neuralNet.EvaluateOneHotCost<TDualNumberN>(dataItem.image, dataItem.label, firstWeight);
+		for (size_t lane = 0; lane < weightCount; ++lane)
+			gradient[firstWeight + lane] = cost.m_dual[lane];
+	}
+
+	return std::span<const float, TNeuralNetwork::c_numWeights>{ gradient.data(), TNeuralNetwork::c_numWeights };
+}
+
+std::span<const float, TNeuralNetwork::c_numWeights> GetGradient_SparseDualNumbers(TNeuralNetwork& neuralNet, const DataItem& dataItem)
+{
+	static std::vector<float> gradient(TNeuralNetwork::c_numWeights);
+
+	// The dual numbers of the last item aren't used anymore, so their storage can be reused
+	SparseDualNumberArena::ThreadInstance().Reset();
+
+	// Evaluate it and get the cost as a dual number
+	SparseDualNumber cost = neuralNet.EvaluateOneHotCost<SparseDualNumber>(dataItem.image, dataItem.label);
+
+	// extract the gradient. Weights without a dual have a derivative of 0.
+	std::fill(gradient.begin(), gradient.end(), 0.0f);
+	for (const SparseDual& dual : cost.Duals())
+		gradient[dual.index] = dual.value;
 
 	return std::span<const float, TNeuralNetwork::c_numWeights>{ gradient.data(), TNeuralNetwork::c_numWeights };
 }
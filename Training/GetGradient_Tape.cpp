@@ -0,0 +1,25 @@
+///////////////////////////////////////////////////////////////////////////////
+//             Machine Learning Introduction For Game Developers             //
+//         Copyright (c) 2023 Electronic Arts Inc. All rights reserved.      //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Settings.h"
+#include "DataSet.h"
+
+std::span<const float, TNeuralNetwork::c_numWeights> GetGradient_Tape(TNeuralNetwork& neuralNet, const DataItem& dataItem)
+{
+	static std::vector<float> gradient(TNeuralNetwork::c_numWeights);
+
+	// The tape of the last item isn't used anymore. Starting with an empty tape means the weights are the first nodes on it.
+	Tape& tape = Tape::ThreadInstance();
+	tape.Reset();
+
+	// Evaluate it and get the cost, recording the math on the tape
+	TapeNumber cost = neuralNet.EvaluateOneHotCost<TapeNumber>(dataItem.image, dataItem.label);
+
+	// Go backwards over the tape from the cost, and the adjoints of the weights are the gradient
+	std::span<const float> adjoints = tape.Backward(cost.m_node);
+	std::copy(adjoints.begin(), adjoints.begin() + TNeuralNetwork::c_numWeights, gradient.begin());
+
+	return std::span<const float, TNeuralNetwork::c_numWeights>{ gradient.data(), TNeuralNetwork::c_numWeights };
+}
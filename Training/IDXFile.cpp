@@ -0,0 +1,115 @@
+///////////////////////////////////////////////////////////////////////////////
+//             Machine Learning Introduction For Game Developers             //
+//         Copyright (c) 2023 Electronic Arts Inc. All rights reserved.      //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "IDXFile.h"
+
+#include <string.h>
+
+namespace
+{
+	uint32_t ReadBigEndianU32(const uint8_t* bytes)
+	{
+		return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]);
+	}
+
+	// Reads a big endian value of N bytes into a T. memcpy because the data is not aligned for the type, in general.
+	template <typename T>
+	T ReadBigEndian(const uint8_t* bytes)
+	{
+		uint8_t swapped[sizeof(T)];
+		for (size_t i = 0; i < sizeof(T); ++i)
+			swapped[i] = bytes[sizeof(T) - 1 - i];
+
+		T ret;
+		memcpy(&ret, swapped, sizeof(T));
+		return ret;
+	}
+}
+
+bool IDXFile::Open(const char* fileName)
+{
+	if (!m_file.Open(fileName) || !ParseHeader(m_file.Bytes()))
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void IDXFile::Close()
+{
+	m_file.Close();
+	m_data = std::span<const uint8_t>{};
+	m_numDims = 0;
+}
+
+bool IDXFile::ParseHeader(std::span<const uint8_t> file)
+{
+	// Magic number: 2 zero bytes, the type, and the number of dimensions
+	if (file.size() < 4 || file[0] != 0 || file[1] != 0)
+		return false;
+
+	m_type = (Type)file[2];
+	if (ElementSize(m_type) == 0)
+		return false;
+
+	m_numDims = file[3];
+	size_t headerSize = 4 + m_numDims * sizeof(uint32_t);
+	if (file.size() < headerSize)
+		return false;
+
+	// The data must all be there. The size is checked before each multiply, so that a bad header can't overflow it.
+	size_t dataSize = ElementSize(m_type);
+	for (size_t dimIndex = 0; dimIndex < m_numDims; ++dimIndex)
+	{
+		m_dims[dimIndex] = ReadBigEndianU32(&file[4 + dimIndex * sizeof(uint32_t)]);
+		if (m_dims[dimIndex] != 0 && dataSize > file.size() / m_dims[dimIndex])
+			return false;
+		dataSize *= m_dims[dimIndex];
+	}
+
+	if (file.size() - headerSize < dataSize)
+		return false;
+
+	m_data = file.subspan(headerSize, dataSize);
+	return true;
+}
+
+size_t IDXFile::ItemElementCount() const
+{
+	size_t ret = 1;
+	for (size_t dimIndex = 1; dimIndex < m_numDims; ++dimIndex)
+		ret *= m_dims[dimIndex];
+	return ret;
+}
+
+double IDXFile::Element(size_t index) const
+{
+	const uint8_t* bytes = &m_data[index * ElementSize()];
+	switch (m_type)
+	{
+		case Type::UInt8: return double(bytes[0]);
+		case Type::Int8: return double((int8_t)bytes[0]);
+		case Type::Int16: return double(ReadBigEndian<int16_t>(bytes));
+		case Type::Int32: return double(ReadBigEndian<int32_t>(bytes));
+		case Type::Float: return double(ReadBigEndian<float>(bytes));
+		case Type::Double: return ReadBigEndian<double>(bytes);
+	}
+	return 0.0;
+}
+
+size_t IDXFile::ElementSize(Type type)
+{
+	switch (type)
+	{
+		case Type::UInt8: return 1;
+		case Type::Int8: return 1;
+		case Type::Int16: return 2;
+		case Type::Int32: return 4;
+		case Type::Float: return 4;
+		case Type::Double: return 8;
+	}
+	return 0;
+}
@@ -0,0 +1,83 @@
+///////////////////////////////////////////////////////////////////////////////
+//             Machine Learning Introduction For Game Developers             //
+//         Copyright (c) 2023 Electronic Arts Inc. All rights reserved.      //
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <array>
+#include <span>
+#include <stdint.h>
+#include "MappedFile.h"
+
+// A read only view of an IDX file, the format the MNIST data comes in.
+//
+// The file is a MappedFile, so opening it only reads the header, and the data is paged in by the OS as it is touched.
+// The header is parsed without modifying the file, and Data() is a span directly over the file contents.
+//
+// The header is 2 zero bytes, a data type byte, a byte for the number of dimensions, then each dimension as a big endian uint32.
+// The data follows, stored in row major order. Multi byte types are big endian, which Element() converts from.
+class IDXFile
+{
+public:
+	enum class Type : uint8_t
+	{
+		UInt8 = 0x08,
+		Int8 = 0x09,
+		Int16 = 0x0B,
+		Int32 = 0x0C,
+		Float = 0x0D,
+		Double = 0x0E,
+	};
+
+	static constexpr size_t c_maxDims = 255;
+
+	// Returns false, and leaves the file closed, if the file can't be opened, or isn't a valid IDX file.
+	bool Open(const char* fileName);
+	void Close();
+
+	bool IsOpen() const { return m_file.IsOpen(); }
+	bool IsMapped() const { return m_file.IsMapped(); }
+
+	Type DataType() const { return m_type; }
+	size_t ElementSize() const { return ElementSize(m_type); }
+
+	std::span<const uint32_t> Dims() const { return std::span<const uint32_t>{ m_dims.data(), m_numDims }; }
+
+	// The number of items is the first dimension, and the rest of the dimensions are the shape of each item.
+	// A 60000 x 28 x 28 file has 60000 items of 784 elements each.
+	size_t ItemCount() const { return m_numDims > 0 ? m_dims[0] : 0; }
+	size_t ItemElementCount() const;
+
+	// The raw bytes of the data, after the header
+	std::span<const uint8_t> Data() const { return m_data; }
+
+	// The raw bytes of a single item
+	std::span<const uint8_t> Item(size_t index) const
+	{
+		size_t itemSize = ItemElementCount() * ElementSize();
+		return m_data.subspan(index * itemSize, itemSize);
+	}
+
+	// Lets the OS drop the pages of these items from memory, for when they have been read and won't be needed again soon
+	void EvictItems(size_t index, size_t count) const
+	{
+		size_t itemSize = ItemElementCount() * ElementSize();
+		m_file.Evict(m_data.subspan(index * itemSize, count * itemSize));
+	}
+
+	// Reads an element of any type, converting it from big endian
+	double Element(size_t index) const;
+
+	static size_t ElementSize(Type type);
+
+private:
+	bool ParseHeader(std::span<const uint8_t> file);
+
+	std::span<const uint8_t> m_data;
+	Type m_type = Type::UInt8;
+	size_t m_numDims = 0;
+	std::array<uint32_t, c_maxDims> m_dims = {};
+
+	MappedFile m_file;
+};
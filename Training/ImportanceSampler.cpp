@@ -0,0 +1,190 @@
+///////////////////////////////////////////////////////////////////////////////
+//             Machine Learning Introduction For Game Developers             //
+//         Copyright (c) 2023 Electronic Arts Inc. All rights reserved.      //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ImportanceSampler.h"
+#include "Settings.h"
+
+#include <algorithm>
+
+// Builds an alias table with Vose's method, for picking index i of count with a probability of weights[i] / sum(weights).
+// To pick: choose i uniformly, then keep it if a uniform random number in [0, 1) is below probability[i], else use alias[i].
+// scaled, small and large are scratch space of at least count items.
+// Returns the sum of the weights.
+template <typename WEIGHT, typename ALIAS>
+static double BuildAliasTable(const WEIGHT* weights, size_t count, float* probability, ALIAS* alias, float* scaled, uint32_t* small, uint32_t* large)
+{
+	double sum = 0.0;
+	for (size_t index = 0; index < count; ++index)
+		sum += double(weights[index]);
+
+	// If the weights are all 0, every index is picked uniformly
+	if (sum <= 0.0)
+	{
+		for (size_t index = 0; index < count; ++index)
+		{
+			probability[index] = 1.0f;
+			alias[index] = ALIAS(index);
+		}
+		return sum;
+	}
+
+	// Scale the weights so that the average is 1. Each index gets a column of height 1, which is filled first by its own
+	// weight, and the rest by a weight larger than 1 that is taking up more than one column.
+	// Which list each index goes in is close to random, so it is written to both, and only the count of the right one goes up.
+	float scale = float(double(count) / sum);
+	size_t smallCount = 0;
+	size_t largeCount = 0;
+	for (size_t index = 0; index < count; ++index)
+	{
+		float value = float(weights[index]) * scale;
+		scaled[index] = value;
+		bool isSmall = value < 1.0f;
+		small[smallCount] = uint32_t(index);
+		large[largeCount] = uint32_t(index);
+		smallCount += isSmall;
+		largeCount += !isSmall;
+	}
+
+	while (smallCount > 0 && largeCount > 0)
+	{
+		uint32_t smallIndex = small[--smallCount];
+		uint32_t largeIndex = large[largeCount - 1];
+
+		probability[smallIndex] = scaled[smallIndex];
+		alias[smallIndex] = ALIAS(largeIndex);
+
+		// The large weight gave up part of itself to fill the small column
+		scaled[largeIndex] = (scaled[largeIndex] + scaled[smallIndex]) - 1.0f;
+		if (scaled[largeIndex] < 1.0f)
+		{
+			largeCount--;
+			small[smallCount++] = largeIndex;
+		}
+	}
+
+	// What's left is 1, give or take rounding
+	for (size_t index = 0; index < largeCount; ++index)
+	{
+		probability[large[index]] = 1.0f;
+		alias[large[index]] = ALIAS(large[index]);
+	}
+	for (size_t index = 0; index < smallCount; ++index)
+	{
+		probability[small[index]] = 1.0f;
+		alias[small[index]] = ALIAS(small[index]);
+	}
+
+	return sum;
+}
+
+ImportanceSampler::ImportanceSampler(size_t itemCount, float uniformMix)
+	: m_uniformMix(std::clamp(uniformMix, 0.0f, 1.0f))
+	, m_losses(itemCount, 1.0f)
+	, m_tableLosses(itemCount, 1.0f)
+	, m_itemProbability(itemCount)
+	, m_itemAlias(itemCount)
+{
+	size_t blockCount = (itemCount + c_blockSize - 1) / c_blockSize;
+	m_blockLosses.resize(blockCount);
+	m_blockProbability.resize(blockCount);
+	m_blockAlias.resize(blockCount);
+	m_blockDirty.resize(blockCount, 1);
+	m_dirtyBlocks.resize(blockCount);
+	for (size_t blockIndex = 0; blockIndex < blockCount; ++blockIndex)
+		m_dirtyBlocks[blockIndex] = uint32_t(blockIndex);
+
+	m_scaled.resize(blockCount);
+	m_small.resize(blockCount);
+	m_large.resize(blockCount);
+
+	Rebuild();
+}
+
+void ImportanceSampler::SetLoss(size_t index, float loss)
+{
+	m_losses[index] = loss;
+
+	size_t blockIndex = index / c_blockSize;
+	if (!m_blockDirty[blockIndex])
+	{
+		m_blockDirty[blockIndex] = 1;
+		m_dirtyBlocks.push_back(uint32_t(blockIndex));
+	}
+}
+
+void ImportanceSampler::Rebuild()
+{
+	if (m_dirtyBlocks.empty())
+		return;
+
+	// The blocks don't share anything, so they can be rebuilt in parallel
+	int dirtyBlockCount = int(m_dirtyBlocks.size());
+	#if MULTI_THREADED()
+	#pragma omp parallel for schedule(static)
+	#endif
+	for (int dirtyIndex = 0; dirtyIndex < dirtyBlockCount; ++dirtyIndex)
+	{
+		RebuildBlock(m_dirtyBlocks[dirtyIndex]);
+		m_blockDirty[m_dirtyBlocks[dirtyIndex]] = 0;
+	}
+	m_dirtyBlocks.clear();
+
+	RebuildBlockTable();
+}
+
+void ImportanceSampler::RebuildBlock(size_t blockIndex)
+{
+	size_t blockBegin = blockIndex * c_blockSize;
+	size_t blockCount = std::min(c_blockSize, m_losses.size() - blockBegin);
+
+	std::copy(&m_losses[blockBegin], &m_losses[blockBegin] + blockCount, &m_tableLosses[blockBegin]);
+
+	float scaled[c_blockSize];
+	uint32_t small[c_blockSize];
+	uint32_t large[c_blockSize];
+	m_blockLosses[blockIndex] = BuildAliasTable(&m_tableLosses[blockBegin], blockCount, &m_itemProbability[blockBegin], &m_itemAlias[blockBegin], scaled, small, large);
+}
+
+void ImportanceSampler::RebuildBlockTable()
+{
+	m_totalLoss = BuildAliasTable(m_blockLosses.data(), m_blockLosses.size(), m_blockProbability.data(), m_blockAlias.data(), m_scaled.data(), m_small.data(), m_large.data());
+}
+
+ImportanceSampler::Sample ImportanceSampler::Draw(std::mt19937& rng) const
+{
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	const size_t itemCount = m_losses.size();
+
+	Sample ret;
+
+	// If all the costs are 0, there's nothing to go on, so pick uniformly
+	if (m_totalLoss <= 0.0 || unit(rng) < m_uniformMix)
+	{
+		ret.index = std::uniform_int_distribution<size_t>(0, itemCount - 1)(rng);
+	}
+	else
+	{
+		// Pick a block by its total cost, then an item in that block by its cost
+		size_t blockIndex = std::uniform_int_distribution<size_t>(0, m_blockLosses.size() - 1)(rng);
+		if (unit(rng) >= m_blockProbability[blockIndex])
+			blockIndex = m_blockAlias[blockIndex];
+
+		size_t blockBegin = blockIndex * c_blockSize;
+		size_t blockCount = std::min(c_blockSize, itemCount - blockBegin);
+		size_t itemIndex = std::uniform_int_distribution<size_t>(0, blockCount - 1)(rng);
+		if (unit(rng) >= m_itemProbability[blockBegin + itemIndex])
+			itemIndex = m_itemAlias[blockBegin + itemIndex];
+
+		ret.index = blockBegin + itemIndex;
+	}
+
+	// The chance this item had of being picked, from both the uniform and the cost based picking
+	double probability = 1.0 / double(itemCount);
+	if (m_totalLoss > 0.0)
+		probability = double(m_uniformMix) / double(itemCount) + double(1.0f - m_uniformMix) * double(m_tableLosses[ret.index]) / m_totalLoss;
+	ret.weight = float(1.0 / (double(itemCount) * probability));
+
+	return ret;
+}
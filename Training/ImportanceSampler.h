@@ -0,0 +1,79 @@
+///////////////////////////////////////////////////////////////////////////////
+//             Machine Learning Introduction For Game Developers             //
+//         Copyright (c) 2023 Electronic Arts Inc. All rights reserved.      //
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <random>
+#include <stdint.h>
+#include <vector>
+
+// Picks training items with a probability proportional to how high their cost was the last time they were trained on, so that the
+// items the network gets wrong are trained on more often than the ones it already gets right.
+//
+// Picking items unevenly biases the gradient towards the picked items, so each item also gets an importance weight of 1 / (N * p),
+// where p is the chance it had of being picked. Multiplying an item's gradient by its weight makes the average weighted gradient
+// the same, on average, as the gradient of uniformly picked items.
+//
+// To keep every item in play, and to keep the weights from getting huge for items with a tiny cost, a fraction uniformMix of the
+// picks are uniform. That makes every p at least uniformMix / N, so no weight is more than 1 / uniformMix.
+//
+// The picking is done with alias tables (Vose's method), which take 2 random numbers and 2 lookups per pick. An alias table can't be
+// updated in place though, so the items are split into blocks of c_blockSize, and there are two levels of tables: one that picks a
+// block by its total cost, and one per block that picks an item within it. Rebuild() only rebuilds the tables of the blocks that
+// had a cost change, plus the table of blocks, and the blocks are rebuilt in parallel. That keeps it cheap enough to do every few mini batches.
+//
+// SetLoss() writes to the current costs, but picking and the weights use the costs from the last Rebuild(), so that the weights
+// always match the chances that the items were really picked with.
+class ImportanceSampler
+{
+public:
+	struct Sample
+	{
+		size_t index = 0;
+		float weight = 1.0f;
+	};
+
+	// Every item starts with the same cost, so picking is uniform until costs are set
+	ImportanceSampler(size_t itemCount, float uniformMix);
+
+	size_t size() const { return m_losses.size(); }
+
+	void SetLoss(size_t index, float loss);
+
+	// Makes the costs set since the last rebuild be the ones that picking uses
+	void Rebuild();
+
+	Sample Draw(std::mt19937& rng) const;
+
+private:
+	static constexpr size_t c_blockSize = 32;
+
+	void RebuildBlock(size_t blockIndex);
+	void RebuildBlockTable();
+
+	float m_uniformMix = 0.0f;
+
+	// The latest cost of each item, and the cost that the tables were built with
+	std::vector<float> m_losses;
+	std::vector<float> m_tableLosses;
+
+	// The alias table of each block, stored flat. The alias is the index of the other item in the same block, so fits in a byte.
+	std::vector<float> m_itemProbability;
+	std::vector<uint8_t> m_itemAlias;
+
+	// The total cost of each block, and the alias table that picks a block
+	std::vector<double> m_blockLosses;
+	std::vector<float> m_blockProbability;
+	std::vector<uint32_t> m_blockAlias;
+	double m_totalLoss = 0.0;
+
+	std::vector<uint8_t> m_blockDirty;
+	std::vector<uint32_t> m_dirtyBlocks;
+
+	// Scratch space for building the table of blocks
+	std::vector<float> m_scaled;
+	std::vector<uint32_t> m_small;
+	std::vector<uint32_t> m_large;
+};
@@ -0,0 +1,187 @@
+///////////////////////////////////////////////////////////////////////////////
+//             Machine Learning Introduction For Game Developers             //
+//         Copyright (c) 2023 Electronic Arts Inc. All rights reserved.      //
+///////////////////////////////////////////////////////////////////////////////
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "MappedFile.h"
+
+#include <stdio.h>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// Maps the whole file read only. Returns nullptr on failure.
+	void* MapFile(const char* fileName, size_t& size)
+	{
+		size = 0;
+
+#ifdef _WIN32
+		HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return nullptr;
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			CloseHandle(file);
+			return nullptr;
+		}
+
+		// The view keeps the file mapped after the handles are closed
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);
+		if (!mapping)
+			return nullptr;
+
+		void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+		if (!view)
+			return nullptr;
+
+		size = (size_t)fileSize.QuadPart;
+		return view;
+#else
+		int file = open(fileName, O_RDONLY);
+		if (file < 0)
+			return nullptr;
+
+		struct stat fileStat;
+		if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0)
+		{
+			close(file);
+			return nullptr;
+		}
+
+		// The mapping keeps the file mapped after the file descriptor is closed
+		void* view = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		close(file);
+		if (view == MAP_FAILED)
+			return nullptr;
+
+		size = (size_t)fileStat.st_size;
+		return view;
+#endif
+	}
+
+	void UnmapFile(void* view, size_t size)
+	{
+#ifdef _WIN32
+		(void)size;
+		UnmapViewOfFile(view);
+#else
+		munmap(view, size);
+#endif
+	}
+
+	bool LoadFileIntoMemory(const char* fileName, std::vector<uint8_t>& contents)
+	{
+		// Plain fopen, since this is used on every platform. _CRT_SECURE_NO_WARNINGS keeps MSVC from warning about it.
+		FILE* file = fopen(fileName, "rb");
+		if (!file)
+			return false;
+
+		long size = -1;
+		if (fseek(file, 0, SEEK_END) == 0)
+			size = ftell(file);
+		if (size < 0 || fseek(file, 0, SEEK_SET) != 0)
+		{
+			fclose(file);
+			return false;
+		}
+		contents.resize((size_t)size, 0);
+
+		bool success = fread(contents.data(), 1, contents.size(), file) == contents.size();
+
+		fclose(file);
+		return success;
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		Close();
+
+		m_bytes = std::exchange(other.m_bytes, std::span<const uint8_t>{});
+		m_mapping = std::exchange(other.m_mapping, nullptr);
+
+		// Moving a vector keeps its allocation, so m_bytes still points at the right place
+		m_fallback = std::move(other.m_fallback);
+		other.m_fallback.clear();
+	}
+	return *this;
+}
+
+bool MappedFile::Open(const char* fileName)
+{
+	Close();
+
+	size_t size = 0;
+	m_mapping = MapFile(fileName, size);
+	if (m_mapping)
+	{
+		m_bytes = std::span<const uint8_t>{ (const uint8_t*)m_mapping, size };
+		return true;
+	}
+
+	if (!LoadFileIntoMemory(fileName, m_fallback) || m_fallback.empty())
+	{
+		Close();
+		return false;
+	}
+	m_bytes = m_fallback;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_mapping)
+		UnmapFile(m_mapping, m_bytes.size());
+	m_mapping = nullptr;
+
+	m_fallback.clear();
+	m_fallback.shrink_to_fit();
+
+	m_bytes = std::span<const uint8_t>{};
+}
+
+void MappedFile::Evict(std::span<const uint8_t> bytes) const
+{
+	if (!m_mapping || bytes.empty())
+		return;
+
+#ifdef _WIN32
+	// Unlocking pages that aren't locked removes them from the working set
+	VirtualUnlock((void*)bytes.data(), bytes.size());
+#else
+	// madvise needs a page aligned address. Rounding out includes a little of the neighboring data, which is fine since it's read only.
+	uintptr_t pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t begin = (uintptr_t)bytes.data() & ~(pageSize - 1);
+	uintptr_t end = (uintptr_t)(bytes.data() + bytes.size());
+	madvise((void*)begin, end - begin, MADV_DONTNEED);
+#endif
+}
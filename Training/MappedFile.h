@@ -0,0 +1,45 @@
+///////////////////////////////////////////////////////////////////////////////
+//             Machine Learning Introduction For Game Developers             //
+//         Copyright (c) 2023 Electronic Arts Inc. All rights reserved.      //
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <span>
+#include <stdint.h>
+#include <vector>
+
+// A read only view of the whole contents of a file.
+// The file is memory mapped, so opening it is quick, and the contents are paged in by the OS as they are touched.
+// If the file can't be mapped, it falls back to reading the whole file into memory.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Returns false, and leaves the file closed, if the file can't be opened or is empty
+	bool Open(const char* fileName);
+	void Close();
+
+	bool IsOpen() const { return m_bytes.data() != nullptr; }
+	bool IsMapped() const { return m_mapping != nullptr; }
+
+	std::span<const uint8_t> Bytes() const { return m_bytes; }
+
+	// Tells the OS that a range of Bytes() won't be needed again soon, so it can drop those pages from memory.
+	// They are read from the file again if they are touched later. Does nothing if the file isn't mapped.
+	void Evict(std::span<const uint8_t> bytes) const;
+
+private:
+	std::span<const uint8_t> m_bytes;
+
+	// The mapped view of the file, when memory mapping worked, or the file contents when it didn't
+	void* m_mapping = nullptr;
+	std::vector<uint8_t> m_fallback;
+};
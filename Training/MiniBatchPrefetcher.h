@@ -0,0 +1,151 @@
+///////////////////////////////////////////////////////////////////////////////
+//             Machine Learning Introduction For Game Developers             //
+//         Copyright (c) 2023 Electronic Arts Inc. All rights reserved.      //
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <span>
+#include <thread>
+#include <vector>
+#include "AlignedAllocator.h"
+#include "Augment.h"
+
+// Gathers the mini batches of an epoch into contiguous staging buffers on producer threads, while the training thread trains on
+// the mini batch before it. Reading the training data through the shuffled training order is a cold, random access for every item,
+// so this moves those cache misses off of the training thread, and hands it the items of each mini batch next to each other in memory.
+//
+// The buffers are a ring, passed between the threads without locks. Mini batch i goes in buffer (i % NUM_BUFFERS), and is filled by
+// producer (i % numProducers) once the consumer has released the mini batch that was in that buffer before. The consumer reads the
+// buffers in order, once the producer has marked them filled. NUM_BUFFERS = 2 with one producer is double buffering.
+//
+// When augmenting, each producer makes a randomly distorted copy of every item instead of a straight copy, with its own ImageAugmenter.
+// Augmentation costs a lot more than copying, which is why there can be more than one producer.
+//
+// Make one per epoch, after shuffling the training order. The training order must not change while the prefetcher exists.
+// DATA_ITEM is the type of the items in the data set, DataItem or CompactDataItem.
+template <typename DATA_ITEM, size_t NUM_BUFFERS>
+class MiniBatchPrefetcher
+{
+public:
+	// numProducers must be no more than NUM_BUFFERS, so that every producer can have a buffer to fill.
+	// With augmentation, producer i seeds its random number generator with augmentSeed + i.
+	MiniBatchPrefetcher(std::span<const DATA_ITEM> data, std::span<const int> order, size_t miniBatchSize, size_t numProducers = 1, bool augment = false, uint32_t augmentSeed = 0)
+		: m_data(data)
+		, m_order(order)
+		, m_miniBatchSize(miniBatchSize)
+		, m_augment(augment)
+	{
+		for (AlignedVector<DATA_ITEM>& buffer : m_buffers)
+			buffer.resize(miniBatchSize);
+
+		numProducers = std::clamp<size_t>(numProducers, 1, NUM_BUFFERS);
+		for (size_t producerIndex = 0; producerIndex < numProducers; ++producerIndex)
+			m_producers.emplace_back([this, producerIndex, numProducers, augmentSeed]() { Produce(producerIndex, numProducers, augmentSeed + uint32_t(producerIndex)); });
+	}
+
+	~MiniBatchPrefetcher()
+	{
+		// If the consumer stopped early, the producers could be waiting for a free buffer.
+		// Changing m_consumed wakes them up to see that they should stop.
+		m_stop.store(true, std::memory_order_relaxed);
+		m_consumed.fetch_add(NUM_BUFFERS, std::memory_order_release);
+		m_consumed.notify_all();
+		for (std::thread& producer : m_producers)
+			producer.join();
+	}
+
+	// Returns the next mini batch, waiting for its producer if it isn't ready yet.
+	// Only one mini batch can be acquired at a time, and it stays valid until Release() is called.
+	std::span<const DATA_ITEM> Acquire()
+	{
+		size_t consumed = m_consumed.load(std::memory_order_relaxed);
+		size_t bufferIndex = consumed % NUM_BUFFERS;
+		std::atomic<size_t>& filled = m_filled[bufferIndex].value;
+
+		size_t filledBatch = filled.load(std::memory_order_acquire);
+		while (filledBatch != consumed + 1)
+		{
+			filled.wait(filledBatch, std::memory_order_acquire);
+			filledBatch = filled.load(std::memory_order_acquire);
+		}
+
+		return std::span<const DATA_ITEM>{ m_buffers[bufferIndex].data(), m_counts[bufferIndex] };
+	}
+
+	// Gives the mini batch from Acquire() back to the producers to fill again
+	void Release()
+	{
+		m_consumed.fetch_add(1, std::memory_order_release);
+		m_consumed.notify_all();
+	}
+
+private:
+	void Produce(size_t producerIndex, size_t numProducers, uint32_t augmentSeed)
+	{
+		std::unique_ptr<ImageAugmenter> augmenter;
+		if (m_augment)
+			augmenter = std::make_unique<ImageAugmenter>(augmentSeed);
+
+		size_t batchCount = (m_order.size() + m_miniBatchSize - 1) / m_miniBatchSize;
+		for (size_t batchIndex = producerIndex; batchIndex < batchCount; batchIndex += numProducers)
+		{
+			// Wait for the consumer to release the mini batch that was in this buffer
+			size_t consumed = m_consumed.load(std::memory_order_acquire);
+			while (batchIndex >= consumed + NUM_BUFFERS)
+			{
+				m_consumed.wait(consumed, std::memory_order_acquire);
+				consumed = m_consumed.load(std::memory_order_acquire);
+			}
+
+			if (m_stop.load(std::memory_order_relaxed))
+				return;
+
+			// Gather the mini batch into the buffer
+			size_t bufferIndex = batchIndex % NUM_BUFFERS;
+			size_t orderBegin = batchIndex * m_miniBatchSize;
+			size_t orderEnd = std::min(orderBegin + m_miniBatchSize, m_order.size());
+			for (size_t orderIndex = orderBegin; orderIndex < orderEnd; ++orderIndex)
+			{
+				const DATA_ITEM& source = m_data[m_order[orderIndex]];
+				DATA_ITEM& dest = m_buffers[bufferIndex][orderIndex - orderBegin];
+				if (augmenter)
+					AugmentDataItem(source, dest, *augmenter);
+				else
+					dest = source;
+			}
+			m_counts[bufferIndex] = orderEnd - orderBegin;
+
+			// Hand it to the consumer
+			m_filled[bufferIndex].value.store(batchIndex + 1, std::memory_order_release);
+			m_filled[bufferIndex].value.notify_one();
+		}
+	}
+
+	// An atomic on its own cache line, so that threads writing different ones don't slow each other down
+	struct alignas(64) PaddedAtomic
+	{
+		std::atomic<size_t> value = 0;
+	};
+
+	std::span<const DATA_ITEM> m_data;
+	std::span<const int> m_order;
+	size_t m_miniBatchSize = 0;
+	bool m_augment = false;
+
+	std::array<AlignedVector<DATA_ITEM>, NUM_BUFFERS> m_buffers;
+	std::array<size_t, NUM_BUFFERS> m_counts = {};
+
+	// For each buffer, 1 + the index of the mini batch that was last put in it. The consumer waits for this to be the mini batch it wants.
+	std::array<PaddedAtomic, NUM_BUFFERS> m_filled;
+
+	// How many mini batches have been consumed, in total
+	alignas(64) std::atomic<size_t> m_consumed = 0;
+	std::atomic<bool> m_stop = false;
+
+	std::vector<std::thread> m_producers;
+};
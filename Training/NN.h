@@ -5,15 +5,24 @@
 
 #pragma once
 
+#include <atomic>
 #include <random>
 #include <span>
+#include <type_traits>
+#include "AlignedAllocator.h"
 #include "StackPoolAllocator.h"
 #include "DualNumber.h"
+#include "DualNumberN.h"
+#include "SparseDualNumber.h"
+#include "TapeNumber.h"
+#include "SIMD.h"
+#include "Sigmoid.h"
 
 // Note: using std::vector instead of std::array because using array made storing a neural net
 // and gradients on the stack be in danger of running out of stack space, especially if layer
 // sizes are changed for experimentation.  We lose compile time size checking though.
-template <size_t NumInputNeurons, size_t NumHiddenNeurons, size_t NumOutputNeurons>
+// Sigmoid is one of the policies in Sigmoid.h, and chooses how accurately (and how quickly) the activation function is calculated.
+template <size_t NumInputNeurons, size_t NumHiddenNeurons, size_t NumOutputNeurons, typename Sigmoid = ExactSigmoid>
 class NeuralNetwork
 {
 public:
@@ -21,6 +30,8 @@ public:
 	static const size_t c_numHiddenNeurons = NumHiddenNeurons;
 	static const size_t c_numOutputNeurons = NumOutputNeurons;
 
+	using TSigmoid = Sigmoid;
+
 	// There is a weight for each neuron in the previous layer, to each neuron in the current layer.
 	// There is also one extra weight per neuron in each layer, for the bias term.
 	// The activation of the previous layer will include an extra 1.0 for that bias term.
@@ -28,26 +39,42 @@ public:
 	static const size_t c_numOutputWeights = (c_numHiddenNeurons + 1) * c_numOutputNeurons;
 	static const size_t c_numWeights = c_numHiddenWeights + c_numOutputWeights;
 
+	// The layout above, where each neuron has its weights followed by its bias, is the "packed" layout.
+	// Gradients, GetWeight(), ImportWeights() and ExportWeights() all use it, and so does the Backprop_Weights.bin file that the demo loads.
+	// Internally though, the weights going into each neuron are stored as a row that starts on a 64 byte boundary and is padded with
+	// zeros to a multiple of 16 floats, and the biases are stored separately. That way, SIMD code reading a row never has a load split
+	// across two cache lines, and rows don't end with a single odd bias value that needs extra code to handle.
+	static const size_t c_rowAlignment = 64 / sizeof(float);
+	static const size_t c_hiddenRowStride = ((c_numInputNeurons + c_rowAlignment - 1) / c_rowAlignment) * c_rowAlignment;
+	static const size_t c_outputRowStride = ((c_numHiddenNeurons + c_rowAlignment - 1) / c_rowAlignment) * c_rowAlignment;
+
+	// The SIMD kernels that evaluate a layer read the activations all the way to the row stride, so the hidden layer activations
+	// (with the 1.0 for the bias term) are stored padded with zeros to a multiple of 16 floats too. See SIMDKernels::EvaluateLayer.
+	static const size_t c_hiddenActivationStride = ((c_numHiddenNeurons + 1 + c_rowAlignment - 1) / c_rowAlignment) * c_rowAlignment;
+
+	// 8 bit inputs are multiplied by this to put them in [0, 1]
+	static constexpr float c_uint8InputScale = 1.0f / 255.0f;
+
 	// initialize weights and biases to a gaussian distribution random number with mean 0, stddev 1.0
 	NeuralNetwork(std::mt19937& rng)
 	{
+		m_hiddenWeights.resize(c_numHiddenNeurons * c_hiddenRowStride, 0.0f);
+		m_hiddenBiases.resize(c_numHiddenNeurons);
+		m_outputWeights.resize(c_numOutputNeurons * c_outputRowStride, 0.0f);
+		m_outputBiases.resize(c_numOutputNeurons);
+
+		// The random numbers are generated in the packed order, so the network starts out the same as it did with the packed layout
 		std::normal_distribution<float> dist(0.0f, 1.0f);
-		m_weights.resize(c_numWeights);
-		for (float& f : m_weights)
-			f = dist(rng);
+		for (size_t i = 0; i < c_numWeights; ++i)
+			GetWeight(i) = dist(rng);
+		UpdateTransposedOutputWeights();
 	}
 
+	// Returns the weights in the packed layout, as dual numbers where weight i has a dual of 1 at index i,
+	// or as TapeNumber variables, where weight i is the i'th node added to the tape.
+	// Floats don't need this, since they are used directly, from the internal layout, and neither does DualNumberN, which only has duals for K weights.
 	template <typename T>
-	std::span<const T, c_numWeights> GetWeights(StackPoolAllocator<T>& allocator) const;
-
-	template <>
-	std::span<const float, c_numWeights> GetWeights(StackPoolAllocator<float>& allocator) const
-	{
-		return std::span<const float, c_numWeights>{ m_weights.data(), c_numWeights };
-	}
-
-	template <>
-	std::span<const DualNumber, c_numWeights> GetWeights(StackPoolAllocator<DualNumber>& allocator) const
+	std::span<const T, c_numWeights> GetWeights(StackPoolAllocator<T>& allocator) const
 	{
 		// allocate dual numbers for the weights
 		auto ret = allocator.Allocate<c_numWeights, false>();
@@ -55,180 +82,206 @@ public:
 		// Set their real and dual parts
 		for (int i = 0; i < c_numWeights; ++i)
 		{
-			ret[i].Reset();
-			ret[i].m_real = m_weights[i];
-			ret[i].SetDualValue(i, 1.0f);
+			if constexpr (std::is_same_v<T, TapeNumber>)
+			{
+				ret[i] = TapeNumber::Variable(GetWeight(i));
+			}
+			else
+			{
+				ret[i].Reset();
+				ret[i].m_real = GetWeight(i);
+				ret[i].SetDualValue(i, 1.0f);
+			}
 		}
 		return ret;
 	}
 
-	// Returns the gradient, using backpropagation
+	// Returns the gradient, using backpropagation.
+	// The gradient is in a thread local buffer, which the next call on the same thread overwrites.
 	std::span<const float, c_numWeights> ForwardPassAndBackprop(std::span<const float, c_numInputNeurons + 1> input, int label) const
+	{
+		thread_local std::vector<float> gradient(c_numWeights);
+		std::fill(gradient.begin(), gradient.end(), 0.0f);
+
+		std::span<float, c_numWeights> gradientSpan{ gradient.data(), c_numWeights };
+		ForwardPassAndBackprop(input, label, gradientSpan);
+		return gradientSpan;
+	}
+
+	// Adds the gradient multiplied by weight into gradientSum, using backpropagation, and returns the cost of the item.
+	// The derivatives are added straight into gradientSum as they are calculated. See AccumulateGradient() for the math.
+	// Every derivative is a multiple of the output layer's deltaCost/deltaZ, so multiplying those by weight multiplies the whole gradient
+	// by it. Importance sampling uses the weight and the cost, since it picks items by their cost.
+	float ForwardPassAndBackprop(std::span<const float, c_numInputNeurons + 1> input, int label, std::span<float, c_numWeights> gradientSum, float weight = 1.0f) const
+	{
+		return AccumulateGradient(input, label, gradientSum, weight);
+	}
+
+	// The same as above, but the inputs are 8 bit values that are multiplied by c_uint8InputScale, and there is no 1.0 for the bias
+	// term at the end; it is implied. The kernels convert the inputs to floats in registers, so the inputs take a quarter of the memory,
+	// and a quarter of the memory bandwidth, that float inputs do.
+	float ForwardPassAndBackprop(std::span<const uint8_t, c_numInputNeurons> input, int label, std::span<float, c_numWeights> gradientSum, float weight = 1.0f) const
+	{
+		return AccumulateGradient(input, label, gradientSum, weight);
+	}
+
+	// Adds the gradient into gradientSum, using backpropagation.
+	// This is the same math as AccumulateGradient(), but only looks at the input values listed in nonZeroIndices.
+	// An input value of zero contributes nothing to the hidden layer, and the derivative of the weights it multiplies is zero,
+	// so we skip them in the hidden layer dot products, and only add the non zero derivatives into gradientSum.
+	// nonZeroIndices must be sorted, and end with the index of the 1.0 for the bias term.
+	void ForwardPassAndBackpropSparse(std::span<const float, c_numInputNeurons + 1> input, std::span<const uint16_t> nonZeroIndices, int label, std::span<float, c_numWeights> gradientSum) const
 	{
 		// We use a thread local stack allocator to get rid of allocation cost of local arrays.
 		thread_local StackPoolAllocator<float> allocator(
-			c_numHiddenNeurons + 1 +					// hiddenLayerActivations
+			c_hiddenActivationStride +					// hiddenLayerActivations
 			c_numOutputNeurons + 1 +					// outputLayerActivations
 			c_numOutputNeurons +						// OutputLayer_deltaCost_deltaZ
-			c_numHiddenNeurons * c_numOutputNeurons +	// OutputLayer_deltaCost_deltaWeight
-			c_numHiddenNeurons +						// HiddenLayer_deltaCost_deltaZ
-			c_numInputNeurons * c_numHiddenNeurons +    // HiddenLayer_deltaCost_deltaWeight
-			c_numWeights                                // Gradient
+			c_numHiddenNeurons							// HiddenLayer_deltaCost_deltaZ
 		);
 		allocator.Reset();
 
+		const SIMDKernels& kernels = GetSIMDKernels();
 
-		// Evaluate the hidden layer
-		auto hiddenWeights = std::span<const float, c_numHiddenWeights>{ &m_weights[0], c_numHiddenWeights };
-		auto hiddenLayerActivations = EvaluateLayer(input, hiddenWeights, allocator);
+		// Evaluate the hidden layer, using only the non zero inputs.
+		// The biases aren't stored in the weight rows, so the index of the 1.0 for the bias term is left out, and the bias is added on after.
+		auto nonZeroInputIndices = nonZeroIndices.first(nonZeroIndices.size() - 1);
+		auto hiddenLayerActivations = allocator.Allocate<c_hiddenActivationStride, true>();
+		for (size_t hiddenNeuronIndex = 0; hiddenNeuronIndex < c_numHiddenNeurons; ++hiddenNeuronIndex)
+		{
+			float Z = kernels.SparseDotProduct(&m_hiddenWeights[hiddenNeuronIndex * c_hiddenRowStride], input.data(), nonZeroInputIndices.data(), nonZeroInputIndices.size()) + m_hiddenBiases[hiddenNeuronIndex];
+			hiddenLayerActivations[hiddenNeuronIndex] = ActivationFunction(Z);
+		}
+		hiddenLayerActivations[c_numHiddenNeurons] = 1.0f;
 
-		// Evaluate the output layer
-		auto outputWeights = std::span<const float, c_numOutputWeights>{ &m_weights[c_numHiddenWeights], c_numOutputWeights };
-		auto outputLayerActivations = EvaluateLayer(hiddenLayerActivations, outputWeights, allocator);
-
-		// Do backpropagation
-		{
-			// The cost function of the total network that we want to minimize is the sum of the cost function of each output neuron.
-			// 
-			// The cost function of a single neuron is going to be 1/2 (desiredOutput - output)^2.
-			// The 1/2 is there so that the derivative of the cost function (deltaCost/deltaOutput) is output - desiredOutput.
-			// 
-			// In the below:
-			//  * Z is the output of that neuron before the activation function (the sum of the weighted inputs).
-			//  * O ("oh") is Z put through the activation function, and is the neuron output value.
-
-
-			// Output Layer Part 1
-			// 
-			// Calculate deltaCost/deltaZ for each output neuron.
-			// This is also deltaCost/deltaBias since changing the bias changes Z directly, 1:1.
-			//
-			// deltaCost/deltaZ = deltaCost/deltaO * deltaO/deltaZ
-			//
-			// deltaCost/deltaO = O - desiredOutput
-			// 
-			// deltaO/deltaZ = O * (1 - O)
-			//
-			auto OutputLayer_deltaCost_deltaZ = allocator.Allocate<c_numOutputNeurons, false>();
-			for (int outputNeuronIndex = 0; outputNeuronIndex < c_numOutputNeurons; ++outputNeuronIndex)
-			{
-				float desiredOutput = (outputNeuronIndex == label) ? 1.0f : 0.0f;
-				float deltaCost_deltaO = outputLayerActivations[outputNeuronIndex] - desiredOutput;
-				float deltaO_deltaZ = outputLayerActivations[outputNeuronIndex] * (1.0f - outputLayerActivations[outputNeuronIndex]);
-				OutputLayer_deltaCost_deltaZ[outputNeuronIndex] = deltaCost_deltaO * deltaO_deltaZ;
-			}
+		// Evaluate the output layer, add the output layer derivatives into gradientSum, and get deltaCost/deltaZ for the hidden neurons
+		auto HiddenLayer_deltaCost_deltaZ = AccumulateOutputLayerGradient(hiddenLayerActivations.template first<c_numHiddenNeurons + 1>(), label, gradientSum, allocator);
 
-			// Output Layer Part 2
-			//
-			// Calculate deltaCost/deltaWeight for each weight going into each output neuron
-			// 
-			// deltaCost/deltaWeight = deltaCost/deltaZ * deltaZ/deltaWeight
-			//
-			// deltaZ/deltaWeight is the hidden layer activation that goes with each weight, since the weights and activations are multiplied together before being summed.
-			// 
-			// deltaCost/deltaWeight = deltaCost/deltaZ * hiddenLayerActivation
-			//
-			auto OutputLayer_deltaCost_deltaWeight = allocator.Allocate<c_numHiddenNeurons * c_numOutputNeurons, false>();
-			for (int outputNeuronIndex = 0; outputNeuronIndex < c_numOutputNeurons; ++outputNeuronIndex)
-			{
-				for (int hiddenNeuronIndex = 0; hiddenNeuronIndex < c_numHiddenNeurons; ++hiddenNeuronIndex)
-				{
-					OutputLayer_deltaCost_deltaWeight[outputNeuronIndex * c_numHiddenNeurons + hiddenNeuronIndex] = OutputLayer_deltaCost_deltaZ[outputNeuronIndex] * hiddenLayerActivations[hiddenNeuronIndex];
-				}
-			}
+		// Hidden Layer Part 2: deltaCost/deltaWeight for each weight going into the hidden neuron.
+		// Scatter-add the derivatives of only the weights that have a non zero input. The bias is one of those.
+		for (size_t hiddenNeuronIndex = 0; hiddenNeuronIndex < c_numHiddenNeurons; ++hiddenNeuronIndex)
+			kernels.SparseAddScaled(&gradientSum[hiddenNeuronIndex * (c_numInputNeurons + 1)], input.data(), nonZeroIndices.data(), HiddenLayer_deltaCost_deltaZ[hiddenNeuronIndex], nonZeroIndices.size());
+	}
 
-			// Hidden Layer Part 1
-			// 
-			// Calculate deltaCost/deltaZ for each hidden neuron.
-			// This is also deltaCost/deltaBias since changing the bias changes Z directly, 1:1.
-			// 
-			// Each hidden layer neuron contributes to the error of each output neuron, so we need to sum them up the error from all of those paths.
-			// 
-			// Each path has a deltaCost/deltaO of deltaCost/deltaOutputZ * deltaOutputZ/deltaO.
-			// 
-			// Getting the deltaCost/deltaO of the entire neuron means summing up each path.
-			// 
-			// deltaCost/deltaO = Sum( deltaCost/deltaOutputZ * deltaOutputZ/deltaO )
-			// 
-			// deltaCost/deltaOutputZ is already calculated as OutputLayer_deltaCost_deltaZ.
-			// 
-			// deltaOutputZ/deltaO is the value of the weight connecting the hidden and output neuron, the output is multiplied by that weight for that output neuron.
-			//
-			auto HiddenLayer_deltaCost_deltaZ = allocator.Allocate<c_numHiddenNeurons, false>();
-			for (int hiddenNeuronIndex = 0; hiddenNeuronIndex < c_numHiddenNeurons; ++hiddenNeuronIndex)
-			{
-				float deltaCost_deltaO = 0.0f;
-				for (int outputNeuronIndex = 0; outputNeuronIndex < c_numOutputNeurons; ++outputNeuronIndex)
-					deltaCost_deltaO += OutputLayer_deltaCost_deltaZ[outputNeuronIndex] * m_weights[c_numHiddenWeights + outputNeuronIndex * (c_numHiddenNeurons + 1) + hiddenNeuronIndex];
-				float deltaO_deltaZ = hiddenLayerActivations[hiddenNeuronIndex] * (1.0f - hiddenLayerActivations[hiddenNeuronIndex]);
-				HiddenLayer_deltaCost_deltaZ[hiddenNeuronIndex] = deltaCost_deltaO * deltaO_deltaZ;
-			}
+	// Adds the summed gradient of a whole mini batch into gradientSum, using backpropagation.
+	// This is the same math as AccumulateGradient(), but each layer is done for the whole batch at once, as a matrix-matrix multiply.
+	// The multiplies are blocked over the batch, so each row of weights is loaded once for several items, and each row of the
+	// gradient is loaded and stored once for the whole batch, instead of once per item.
+	// inputs[i] is an array of c_numInputNeurons + 1 floats (with the 1.0 for the bias term at the end), and labels[i] is its label.
+	// There can be at most MAX_BATCH_SIZE items.
+	template <size_t MAX_BATCH_SIZE>
+	void ForwardPassAndBackpropBatch(std::span<const float* const> inputs, std::span<const int> labels, std::span<float, c_numWeights> gradientSum) const
+	{
+		// We use a thread local stack allocator to get rid of allocation cost of local arrays.
+		thread_local StackPoolAllocator<float> allocator(
+			MAX_BATCH_SIZE * c_hiddenActivationStride +	// hiddenLayerActivations
+			MAX_BATCH_SIZE * c_numOutputNeurons +		// outputLayerActivations
+			MAX_BATCH_SIZE * c_numOutputNeurons +		// OutputLayer_deltaCost_deltaZ
+			MAX_BATCH_SIZE * c_numHiddenNeurons			// HiddenLayer_deltaCost_deltaZ
+		);
+		allocator.Reset();
 
-			// Hidden Layer Part 2
-			// 
-			// Calculate deltaCost/deltaWeight for each weight going into the hidden neuron
-			// 
-			// deltaCost/deltaWeight = deltaCost/deltaZ * deltaZ/deltaWeight
-			// 
-			// deltaZ/deltaWeight is the input layer value that goes with each weight, since the weights and inputs are multiplied together before being summed.
-			// 
-			// deltaCost/deltaWeight = deltaCost/deltaBias * input
-			//
-			auto HiddenLayer_deltaCost_deltaWeight = allocator.Allocate<c_numInputNeurons * c_numHiddenNeurons, false>();
-			for (int hiddenNeuronIndex = 0; hiddenNeuronIndex < c_numHiddenNeurons; ++hiddenNeuronIndex)
-			{
-				for (int inputNeuronIndex = 0; inputNeuronIndex < c_numInputNeurons; ++inputNeuronIndex)
-				{
-					HiddenLayer_deltaCost_deltaWeight[hiddenNeuronIndex * c_numInputNeurons + inputNeuronIndex] = HiddenLayer_deltaCost_deltaZ[hiddenNeuronIndex] * input[inputNeuronIndex];
-				}
-			}
+		const size_t batchSize = inputs.size();
+		if (batchSize > MAX_BATCH_SIZE || labels.size() != batchSize)
+		{
+			printf("ERROR: " __FUNCTION__ "(): batch is the wrong size.\n");
+			return;
+		}
 
-			// Copy our derivatives into the proper locations of the gradient array
-			// 
-			// This could be improved by having the above work in the larger gradient vector, instead of temporary arrays, but not doing that because
-			// it would complicate the code, and these copies aren't showing up in profiling.
-			auto gradient = allocator.Allocate<c_numWeights, false>();
-			int outputIndex = 0;
-			for (int hiddenNeuronIndex = 0; hiddenNeuronIndex < c_numHiddenNeurons; ++hiddenNeuronIndex)
-			{
-				memcpy(&gradient[outputIndex], &HiddenLayer_deltaCost_deltaWeight[hiddenNeuronIndex * c_numInputNeurons], sizeof(float) * c_numInputNeurons);
-				outputIndex += c_numInputNeurons;
+		// Evaluate the network for the whole batch
+		auto hiddenLayerActivations = allocator.Allocate(batchSize * c_hiddenActivationStride, false);
+		auto outputLayerActivations = allocator.Allocate(batchSize * c_numOutputNeurons, false);
+		EvaluateBatch<MAX_BATCH_SIZE>(inputs, hiddenLayerActivations, outputLayerActivations);
 
-				gradient[outputIndex] = HiddenLayer_deltaCost_deltaZ[hiddenNeuronIndex];
-				outputIndex++;
-			}
+		// Do backpropagation.
+		// See AccumulateGradient() for an explanation of the math. The only difference here is that each value is done for every batch item.
+		// The deltas are stored as [neuronIndex * batchSize + batchIndex], so that the deltas of a neuron for the whole batch are together,
+		// which is what the gradient multiplies below scale the rows of the batch by.
 
+		// Output Layer Part 1: deltaCost/deltaZ for each output neuron
+		auto OutputLayer_deltaCost_deltaZ = allocator.Allocate(batchSize * c_numOutputNeurons, false);
+		for (size_t batchIndex = 0; batchIndex < batchSize; ++batchIndex)
+		{
 			for (int outputNeuronIndex = 0; outputNeuronIndex < c_numOutputNeurons; ++outputNeuronIndex)
 			{
-				memcpy(&gradient[outputIndex], &OutputLayer_deltaCost_deltaWeight[outputNeuronIndex * c_numHiddenNeurons], sizeof(float) * c_numHiddenNeurons);
-				outputIndex += c_numHiddenNeurons;
-
-				gradient[outputIndex] = OutputLayer_deltaCost_deltaZ[outputNeuronIndex];
-				outputIndex++;
+				float O = outputLayerActivations[batchIndex * c_numOutputNeurons + outputNeuronIndex];
+				float desiredOutput = (outputNeuronIndex == labels[batchIndex]) ? 1.0f : 0.0f;
+				float deltaCost_deltaO = O - desiredOutput;
+				float deltaO_deltaZ = O * (1.0f - O);
+				OutputLayer_deltaCost_deltaZ[outputNeuronIndex * batchSize + batchIndex] = deltaCost_deltaO * deltaO_deltaZ;
 			}
+		}
 
-			return gradient;
+		// Hidden Layer Part 1: deltaCost/deltaZ for each hidden neuron.
+		// This is a (batchSize x 10) * (10 x 30) matrix multiply, followed by the derivative of the activation function.
+		// The (10 x 30) matrix is m_outputWeightsTransposed, so the weights of each hidden neuron are contiguous.
+		auto HiddenLayer_deltaCost_deltaZ = allocator.Allocate(batchSize * c_numHiddenNeurons, false);
+		for (size_t hiddenNeuronIndex = 0; hiddenNeuronIndex < c_numHiddenNeurons; ++hiddenNeuronIndex)
+		{
+			const float* outputWeights = &m_outputWeightsTransposed[hiddenNeuronIndex * c_numOutputNeurons];
+			for (size_t batchIndex = 0; batchIndex < batchSize; ++batchIndex)
+			{
+				float deltaCost_deltaO = 0.0f;
+				for (size_t outputNeuronIndex = 0; outputNeuronIndex < c_numOutputNeurons; ++outputNeuronIndex)
+					deltaCost_deltaO += OutputLayer_deltaCost_deltaZ[outputNeuronIndex * batchSize + batchIndex] * outputWeights[outputNeuronIndex];
+				float O = hiddenLayerActivations[batchIndex * c_hiddenActivationStride + hiddenNeuronIndex];
+				float deltaO_deltaZ = O * (1.0f - O);
+				HiddenLayer_deltaCost_deltaZ[hiddenNeuronIndex * batchSize + batchIndex] = deltaCost_deltaO * deltaO_deltaZ;
+			}
 		}
+
+		// Part 2 of both layers: deltaCost/deltaWeight summed over the batch.
+		// These are the (30 x batchSize) * (batchSize x 785) and (10 x batchSize) * (batchSize x 31) matrix multiplies.
+		// Since the last input value of each layer is the 1.0 for the bias term, the bias derivatives come out of this too, and the
+		// result is already in the packed layout.
+		const SIMDKernels& kernels = GetSIMDKernels();
+		for (size_t hiddenNeuronIndex = 0; hiddenNeuronIndex < c_numHiddenNeurons; ++hiddenNeuronIndex)
+			kernels.AddScaledBatch(&gradientSum[hiddenNeuronIndex * (c_numInputNeurons + 1)], inputs.data(), &HiddenLayer_deltaCost_deltaZ[hiddenNeuronIndex * batchSize], batchSize, c_numInputNeurons + 1);
+
+		const float* hiddenLayerRows[MAX_BATCH_SIZE];
+		for (size_t batchIndex = 0; batchIndex < batchSize; ++batchIndex)
+			hiddenLayerRows[batchIndex] = &hiddenLayerActivations[batchIndex * c_hiddenActivationStride];
+		for (size_t outputNeuronIndex = 0; outputNeuronIndex < c_numOutputNeurons; ++outputNeuronIndex)
+			kernels.AddScaledBatch(&gradientSum[c_numHiddenWeights + outputNeuronIndex * (c_numHiddenNeurons + 1)], hiddenLayerRows, &OutputLayer_deltaCost_deltaZ[outputNeuronIndex * batchSize], batchSize, c_numHiddenNeurons + 1);
 	}
 
-	// Templated so it can take either floats or dual numbers
+	// Templated so it can take either floats or dual numbers.
+	// For DualNumberN, the weights in the packed layout from firstSeededWeight up to K after it are the ones that get a dual of 1.
 	template <typename T>
-	std::span<const T, c_numOutputNeurons> Evaluate(std::span<const float, c_numInputNeurons + 1> input) const
+	std::span<const T, c_numOutputNeurons> Evaluate(std::span<const float, c_numInputNeurons + 1> input, size_t firstSeededWeight = 0) const
 	{
 		// We use a thread local stack allocator to get rid of allocation cost of local arrays.
-		thread_local StackPoolAllocator<T> allocator(c_numHiddenNeurons + 1 + c_numOutputNeurons + 1 + c_numWeights);
+		// DualNumber, SparseDualNumber and TapeNumber make a copy of the weights.
+		constexpr size_t c_numWeightCopies = (std::is_same_v<T, float> || c_isDualNumberN<T>) ? 0 : c_numWeights;
+		thread_local StackPoolAllocator<T> allocator(c_hiddenActivationStride + c_numOutputNeurons + 1 + c_numWeightCopies);
 		allocator.Reset();
 
-		// This is where weights get converted to dual numbers, if needed
-		auto weights = GetWeights<T>(allocator);
+		std::span<const T> outputLayerActivations;
+		if constexpr (std::is_same_v<T, float>)
+		{
+			// Floats use the weights where they are
+			auto hiddenLayer = EvaluateHiddenLayer(input, allocator);
+			outputLayerActivations = EvaluateOutputLayer(hiddenLayer, allocator);
+		}
+		else if constexpr (c_isDualNumberN<T>)
+		{
+			// Only K weights have duals, so the weights stay floats where they are, and the seeded ones get their duals added in
+			auto hiddenLayer = EvaluateLayerSeeded<T, c_numHiddenNeurons>(input.data(), c_numInputNeurons, m_hiddenWeights.data(), c_hiddenRowStride, m_hiddenBiases.data(), 0, firstSeededWeight, allocator);
+			outputLayerActivations = EvaluateLayerSeeded<T, c_numOutputNeurons>(hiddenLayer.data(), c_numHiddenNeurons, m_outputWeights.data(), c_outputRowStride, m_outputBiases.data(), c_numHiddenWeights, firstSeededWeight, allocator);
+		}
+		else
+		{
+			// This is where weights get converted to dual numbers
+			auto weights = GetWeights<T>(allocator);
 
-		// Evaluate the hidden layer
-		auto hiddenWeights = std::span<const T, c_numHiddenWeights>{ &weights[0], c_numHiddenWeights };
-		auto hiddenLayer = EvaluateLayer(input, hiddenWeights, allocator);
+			// Evaluate the hidden layer
+			auto hiddenWeights = std::span<const T, c_numHiddenWeights>{ &weights[0], c_numHiddenWeights };
+			auto hiddenLayer = EvaluateLayer(input, hiddenWeights, allocator);
 
-		// Evaluate the output layer
-		auto outputWeights = std::span<const T, c_numOutputWeights>{ &weights[c_numHiddenWeights], c_numOutputWeights };
-		auto outputLayerActivations = EvaluateLayer(hiddenLayer, outputWeights, allocator);
+			// Evaluate the output layer
+			auto outputWeights = std::span<const T, c_numOutputWeights>{ &weights[c_numHiddenWeights], c_numOutputWeights };
+			outputLayerActivations = EvaluateLayer(hiddenLayer, outputWeights, allocator);
+		}
 
 		// Remove the extra 1.0 at the end, since we are done and there is no next layer with a bias term
 		return std::span<const T, c_numOutputNeurons>{outputLayerActivations.first(c_numOutputNeurons).data(), c_numOutputNeurons};
@@ -240,34 +293,53 @@ public:
 		auto outputLayerActivations = Evaluate<float>(input);
 
 		// return the index of the most activated output neuron
-		int bestNeuron = 0;
-		float bestNeuronActivation = outputLayerActivations[0];
-		for (int i = 1; i < c_numOutputNeurons; ++i)
+		return MostActivatedNeuron(outputLayerActivations.data());
+	}
+
+	// The same as EvaluateOneHot(), but for a whole batch of inputs at once, using the same batched forward pass as ForwardPassAndBackpropBatch().
+	// inputs[i] is an array of c_numInputNeurons + 1 floats, and predictedLabels[i] gets the index of its most activated output neuron.
+	template <size_t MAX_BATCH_SIZE>
+	void EvaluateOneHotBatch(std::span<const float* const> inputs, std::span<int> predictedLabels) const
+	{
+		// We use a thread local stack allocator to get rid of allocation cost of local arrays.
+		thread_local StackPoolAllocator<float> allocator(
+			MAX_BATCH_SIZE * c_hiddenActivationStride +	// hiddenLayerActivations
+			MAX_BATCH_SIZE * c_numOutputNeurons			// outputLayerActivations
+		);
+		allocator.Reset();
+
+		const size_t batchSize = inputs.size();
+		if (batchSize > MAX_BATCH_SIZE || predictedLabels.size() != batchSize)
 		{
-			if (outputLayerActivations[i] > bestNeuronActivation)
-			{
-				bestNeuron = i;
-				bestNeuronActivation = outputLayerActivations[i];
-			}
+			printf("ERROR: " __FUNCTION__ "(): batch is the wrong size.\n");
+			return;
 		}
-		return bestNeuron;
+
+		auto hiddenLayerActivations = allocator.Allocate(batchSize * c_hiddenActivationStride, false);
+		auto outputLayerActivations = allocator.Allocate(batchSize * c_numOutputNeurons, false);
+		EvaluateBatch<MAX_BATCH_SIZE>(inputs, hiddenLayerActivations, outputLayerActivations);
+
+		for (size_t batchIndex = 0; batchIndex < batchSize; ++batchIndex)
+			predictedLabels[batchIndex] = MostActivatedNeuron(&outputLayerActivations[batchIndex * c_numOutputNeurons]);
 	}
 
 	// Cost is mean squared error
-	// Templated so it can take either floats or dual numbers
+	// Templated so it can take either floats or dual numbers. See Evaluate() for firstSeededWeight.
 	template <typename T>
-	T EvaluateOneHotCost(std::span<const float, c_numInputNeurons + 1> input, int expectedOutput) const
+	T EvaluateOneHotCost(std::span<const float, c_numInputNeurons + 1> input, int expectedOutput, size_t firstSeededWeight = 0) const
 	{
 		T ret = {};
 
 		// Evaluate the network
-		auto outputLayerActivations = Evaluate<T>(input);
+		auto outputLayerActivations = Evaluate<T>(input, firstSeededWeight);
 
 		// Calculate and return mean squared error
 		for (size_t i = 0; i < c_numOutputNeurons; ++i)
 		{
 			float target = (i == expectedOutput) ? 1.0f : 0.0f;
-			T error = target - outputLayerActivations[i];
+			// For dual numbers, error is an expression, not a DualNumber, so the error, the square and the lerp are all
+			// calculated in one loop over the duals, when the lerp is assigned to ret.
+			auto error = target - outputLayerActivations[i];
 
 			// This is a way of doing "online averaging" that keeps numbers similar sized to avoid floating point precision issues
 			ret = Lerp(ret, error * error, 1.0f / float(i + 1));
@@ -284,18 +356,382 @@ public:
 			return;
 		}
 
-		// apply update
-		for (size_t i = 0; i < c_numWeights; ++i)
-			m_weights[i] -= gradient[i] * learningRate;
+		UpdateWeights(std::span<const float, c_numWeights>{ gradient.data(), c_numWeights }, learningRate);
+	}
+
+	void UpdateWeights(std::span<const float, c_numWeights> gradient, float learningRate)
+	{
+		// apply update.
+		// Each row of the packed gradient is the weights of a neuron followed by its bias, which go to different places in the internal layout.
+		const SIMDKernels& kernels = GetSIMDKernels();
+		for (size_t hiddenNeuronIndex = 0; hiddenNeuronIndex < c_numHiddenNeurons; ++hiddenNeuronIndex)
+		{
+			const float* gradientRow = &gradient[hiddenNeuronIndex * (c_numInputNeurons + 1)];
+			kernels.AddScaled(&m_hiddenWeights[hiddenNeuronIndex * c_hiddenRowStride], gradientRow, -learningRate, c_numInputNeurons);
+			m_hiddenBiases[hiddenNeuronIndex] -= gradientRow[c_numInputNeurons] * learningRate;
+		}
+		for (size_t outputNeuronIndex = 0; outputNeuronIndex < c_numOutputNeurons; ++outputNeuronIndex)
+		{
+			const float* gradientRow = &gradient[c_numHiddenWeights + outputNeuronIndex * (c_numHiddenNeurons + 1)];
+			kernels.AddScaled(&m_outputWeights[outputNeuronIndex * c_outputRowStride], gradientRow, -learningRate, c_numHiddenNeurons);
+			m_outputBiases[outputNeuronIndex] -= gradientRow[c_numHiddenNeurons] * learningRate;
+		}
+		UpdateTransposedOutputWeights();
+	}
+
+	// One Hogwild! training step, where many threads train on their own items and update the shared weights at the same time, with no locks.
+	// This is sparse backprop (see ForwardPassAndBackpropSparse()) that applies its update straight to the weights, instead of making a gradient.
+	// Only the hidden weights of the non zero inputs have a non zero derivative, so only those and the output layer are read and written,
+	// in the internal layout, and only the touched rows of the transposed output weights are patched.
+	// nonZeroIndices must be sorted, and end with the index of the 1.0 for the bias term.
+	//
+	// Every read and write of a weight is a relaxed atomic, since other threads are writing the same weights. On x86 those are plain scalar
+	// loads and stores, so they cost the same as non atomic scalar code, but they make the races well defined instead of undefined behavior.
+	// The read, subtract and write of an update is not one atomic operation though, so when two threads update the same weight at the
+	// same time, one of the updates is lost. Hogwild! accepts that, because it is rare, and the training still converges.
+	void ForwardPassAndBackpropHogwild(std::span<const float, c_numInputNeurons + 1> input, std::span<const uint16_t> nonZeroIndices, int label, float learningRate)
+	{
+		// We use a thread local stack allocator to get rid of allocation cost of local arrays.
+		thread_local StackPoolAllocator<float> allocator(
+			c_numHiddenNeurons +						// hiddenLayerActivations
+			c_numOutputNeurons +						// outputLayerActivations
+			c_numOutputNeurons +						// OutputLayer_deltaCost_deltaZ
+			c_numHiddenNeurons							// HiddenLayer_deltaCost_deltaZ
+		);
+		allocator.Reset();
+
+		auto LoadWeight = [](float& weight) -> float
+		{
+			return std::atomic_ref<float>(weight).load(std::memory_order_relaxed);
+		};
+
+		auto StoreWeight = [](float& weight, float value)
+		{
+			std::atomic_ref<float>(weight).store(value, std::memory_order_relaxed);
+		};
+
+		// Evaluate the hidden layer, using only the non zero inputs. The bias term is left out of the list, and the bias is added on after.
+		auto nonZeroInputIndices = nonZeroIndices.first(nonZeroIndices.size() - 1);
+		auto hiddenLayerActivations = allocator.Allocate<c_numHiddenNeurons, false>();
+		for (size_t hiddenNeuronIndex = 0; hiddenNeuronIndex < c_numHiddenNeurons; ++hiddenNeuronIndex)
+		{
+			float* weightRow = &m_hiddenWeights[hiddenNeuronIndex * c_hiddenRowStride];
+			float Z = LoadWeight(m_hiddenBiases[hiddenNeuronIndex]);
+			for (uint16_t inputIndex : nonZeroInputIndices)
+				Z += LoadWeight(weightRow[inputIndex]) * input[inputIndex];
+			hiddenLayerActivations[hiddenNeuronIndex] = ActivationFunction(Z);
+		}
+
+		// Evaluate the output layer
+		auto outputLayerActivations = allocator.Allocate<c_numOutputNeurons, false>();
+		for (size_t outputNeuronIndex = 0; outputNeuronIndex < c_numOutputNeurons; ++outputNeuronIndex)
+		{
+			float* weightRow = &m_outputWeights[outputNeuronIndex * c_outputRowStride];
+			float Z = LoadWeight(m_outputBiases[outputNeuronIndex]);
+			for (size_t hiddenNeuronIndex = 0; hiddenNeuronIndex < c_numHiddenNeurons; ++hiddenNeuronIndex)
+				Z += LoadWeight(weightRow[hiddenNeuronIndex]) * hiddenLayerActivations[hiddenNeuronIndex];
+			outputLayerActivations[outputNeuronIndex] = ActivationFunction(Z);
+		}
+
+		// Output Layer Part 1: deltaCost/deltaZ for each output neuron. See AccumulateOutputLayerGradient() for the math.
+		auto OutputLayer_deltaCost_deltaZ = allocator.Allocate<c_numOutputNeurons, false>();
+		for (size_t outputNeuronIndex = 0; outputNeuronIndex < c_numOutputNeurons; ++outputNeuronIndex)
+		{
+			float O = outputLayerActivations[outputNeuronIndex];
+			float desiredOutput = ((int)outputNeuronIndex == label) ? 1.0f : 0.0f;
+			OutputLayer_deltaCost_deltaZ[outputNeuronIndex] = (O - desiredOutput) * O * (1.0f - O);
+		}
+
+		// Hidden Layer Part 1: deltaCost/deltaZ for each hidden neuron.
+		// This has to use the output weights from before this step's update, so it is done before updating them.
+		auto HiddenLayer_deltaCost_deltaZ = allocator.Allocate<c_numHiddenNeurons, false>();
+		for (size_t hiddenNeuronIndex = 0; hiddenNeuronIndex < c_numHiddenNeurons; ++hiddenNeuronIndex)
+		{
+			float* outputWeights = &m_outputWeightsTransposed[hiddenNeuronIndex * c_numOutputNeurons];
+			float deltaCost_deltaO = 0.0f;
+			for (size_t outputNeuronIndex = 0; outputNeuronIndex < c_numOutputNeurons; ++outputNeuronIndex)
+				deltaCost_deltaO += OutputLayer_deltaCost_deltaZ[outputNeuronIndex] * LoadWeight(outputWeights[outputNeuronIndex]);
+			float O = hiddenLayerActivations[hiddenNeuronIndex];
+			HiddenLayer_deltaCost_deltaZ[hiddenNeuronIndex] = deltaCost_deltaO * O * (1.0f - O);
+		}
+
+		// Update the hidden weights of the non zero inputs, and the hidden biases, one row at a time
+		for (size_t hiddenNeuronIndex = 0; hiddenNeuronIndex < c_numHiddenNeurons; ++hiddenNeuronIndex)
+		{
+			float step = HiddenLayer_deltaCost_deltaZ[hiddenNeuronIndex] * learningRate;
+			float* weightRow = &m_hiddenWeights[hiddenNeuronIndex * c_hiddenRowStride];
+			for (uint16_t inputIndex : nonZeroInputIndices)
+				StoreWeight(weightRow[inputIndex], LoadWeight(weightRow[inputIndex]) - step * input[inputIndex]);
+			StoreWeight(m_hiddenBiases[hiddenNeuronIndex], LoadWeight(m_hiddenBiases[hiddenNeuronIndex]) - step);
+		}
+
+		// Update the output weights and biases, and patch the transposed copy of the output weights to match
+		for (size_t outputNeuronIndex = 0; outputNeuronIndex < c_numOutputNeurons; ++outputNeuronIndex)
+		{
+			float step = OutputLayer_deltaCost_deltaZ[outputNeuronIndex] * learningRate;
+			float* weightRow = &m_outputWeights[outputNeuronIndex * c_outputRowStride];
+			for (size_t hiddenNeuronIndex = 0; hiddenNeuronIndex < c_numHiddenNeurons; ++hiddenNeuronIndex)
+			{
+				float newWeight = LoadWeight(weightRow[hiddenNeuronIndex]) - step * hiddenLayerActivations[hiddenNeuronIndex];
+				StoreWeight(weightRow[hiddenNeuronIndex], newWeight);
+				StoreWeight(m_outputWeightsTransposed[hiddenNeuronIndex * c_numOutputNeurons + outputNeuronIndex], newWeight);
+			}
+			StoreWeight(m_outputBiases[outputNeuronIndex], LoadWeight(m_outputBiases[outputNeuronIndex]) - step);
+		}
 	}
 
+	// Returns the weight at an index in the packed layout.
+	// Note: backprop reads the output weights from m_outputWeightsTransposed. If you change output weights through this
+	// reference and then do backprop, call UpdateTransposedOutputWeights() first.
 	float& GetWeight(size_t index)
 	{
-		return m_weights[index];
+		if (index < c_numHiddenWeights)
+		{
+			size_t neuronIndex = index / (c_numInputNeurons + 1);
+			size_t weightIndex = index % (c_numInputNeurons + 1);
+			return (weightIndex == c_numInputNeurons) ? m_hiddenBiases[neuronIndex] : m_hiddenWeights[neuronIndex * c_hiddenRowStride + weightIndex];
+		}
+
+		index -= c_numHiddenWeights;
+		size_t neuronIndex = index / (c_numHiddenNeurons + 1);
+		size_t weightIndex = index % (c_numHiddenNeurons + 1);
+		return (weightIndex == c_numHiddenNeurons) ? m_outputBiases[neuronIndex] : m_outputWeights[neuronIndex * c_outputRowStride + weightIndex];
+	}
+
+	float GetWeight(size_t index) const
+	{
+		return const_cast<NeuralNetwork*>(this)->GetWeight(index);
+	}
+
+	// Copy all the weights in or out, in the packed layout
+	void ImportWeights(std::span<const float, c_numWeights> weights)
+	{
+		for (size_t i = 0; i < c_numWeights; ++i)
+			GetWeight(i) = weights[i];
+		UpdateTransposedOutputWeights();
+	}
+
+	void ExportWeights(std::span<float, c_numWeights> weights) const
+	{
+		for (size_t i = 0; i < c_numWeights; ++i)
+			weights[i] = GetWeight(i);
+	}
+
+	// Backprop needs the output weights column by column (all the weights coming out of one hidden neuron), but m_outputWeights stores
+	// them row by row (all the weights going into one output neuron). We keep a transposed copy so that those reads are contiguous
+	// instead of having a stride of c_outputRowStride. The copy is made again whenever the weights are updated.
+	void UpdateTransposedOutputWeights()
+	{
+		m_outputWeightsTransposed.resize(c_numHiddenNeurons * c_numOutputNeurons);
+		for (size_t outputNeuronIndex = 0; outputNeuronIndex < c_numOutputNeurons; ++outputNeuronIndex)
+		{
+			const float* weightRow = &m_outputWeights[outputNeuronIndex * c_outputRowStride];
+			for (size_t hiddenNeuronIndex = 0; hiddenNeuronIndex < c_numHiddenNeurons; ++hiddenNeuronIndex)
+				m_outputWeightsTransposed[hiddenNeuronIndex * c_numOutputNeurons + outputNeuronIndex] = weightRow[hiddenNeuronIndex];
+		}
 	}
 
 private:
 
+	// Evaluates the network for a whole batch of inputs at once.
+	// The hidden layer is a (batchSize x 784) * (784 x 30) matrix multiply, and the output layer is a (batchSize x 30) * (30 x 10) matrix multiply.
+	// The kernel does several items per pass over each weight row, so the row is loaded once for those items.
+	// hiddenLayerActivations is [batchIndex * c_hiddenActivationStride + hiddenNeuronIndex], and each row has an extra 1.0 at the end for the
+	// bias term of the output layer. outputLayerActivations is [batchIndex * c_numOutputNeurons + outputNeuronIndex].
+	template <size_t MAX_BATCH_SIZE>
+	void EvaluateBatch(std::span<const float* const> inputs, std::span<float> hiddenLayerActivations, std::span<float> outputLayerActivations) const
+	{
+		const SIMDKernels& kernels = GetSIMDKernels();
+		const size_t batchSize = inputs.size();
+
+		// The kernel reads each input up to c_hiddenRowStride, so if that is past the end of the inputs, they are copied into zero padded rows
+		const float* const* hiddenLayerInputs = inputs.data();
+		const float* paddedInputRows[MAX_BATCH_SIZE];
+		if constexpr (c_hiddenRowStride > c_numInputNeurons + 1)
+		{
+			thread_local AlignedVector<float> paddedInputs(MAX_BATCH_SIZE * c_hiddenRowStride, 0.0f);
+			for (size_t batchIndex = 0; batchIndex < batchSize; ++batchIndex)
+			{
+				paddedInputRows[batchIndex] = &paddedInputs[batchIndex * c_hiddenRowStride];
+				std::copy(inputs[batchIndex], inputs[batchIndex] + c_numInputNeurons + 1, &paddedInputs[batchIndex * c_hiddenRowStride]);
+			}
+			hiddenLayerInputs = paddedInputRows;
+		}
+
+		// Calculate Z for every hidden neuron, then put each row through the activation function at once
+		kernels.EvaluateLayerBatch(m_hiddenWeights.data(), c_hiddenRowStride, m_hiddenBiases.data(), hiddenLayerInputs, batchSize, c_numHiddenNeurons, hiddenLayerActivations.data(), c_hiddenActivationStride);
+		const float* hiddenLayerRows[MAX_BATCH_SIZE];
+		for (size_t batchIndex = 0; batchIndex < batchSize; ++batchIndex)
+		{
+			float* hiddenLayerRow = &hiddenLayerActivations[batchIndex * c_hiddenActivationStride];
+			Sigmoid::Evaluate(hiddenLayerRow, c_numHiddenNeurons);
+			hiddenLayerRow[c_numHiddenNeurons] = 1.0f;
+			std::fill(&hiddenLayerRow[c_numHiddenNeurons + 1], &hiddenLayerRow[c_hiddenActivationStride], 0.0f);
+			hiddenLayerRows[batchIndex] = hiddenLayerRow;
+		}
+
+		// The output layer has no bias term after it, so the whole array goes through the activation function in one go
+		kernels.EvaluateLayerBatch(m_outputWeights.data(), c_outputRowStride, m_outputBiases.data(), hiddenLayerRows, batchSize, c_numOutputNeurons, outputLayerActivations.data(), c_numOutputNeurons);
+		Sigmoid::Evaluate(outputLayerActivations.data(), batchSize * c_numOutputNeurons);
+	}
+
+	// Returns the index of the most activated output neuron
+	static int MostActivatedNeuron(const float* outputLayerActivations)
+	{
+		int bestNeuron = 0;
+		float bestNeuronActivation = outputLayerActivations[0];
+		for (int i = 1; i < c_numOutputNeurons; ++i)
+		{
+			if (outputLayerActivations[i] > bestNeuronActivation)
+			{
+				bestNeuron = i;
+				bestNeuronActivation = outputLayerActivations[i];
+			}
+		}
+		return bestNeuron;
+	}
+
+	// The accumulating ForwardPassAndBackprop() overloads, for float or 8 bit inputs.
+	// They only differ in how the inputs are read: EvaluateHiddenLayer() has an overload for each, and the hidden layer gradient uses
+	// AddScaled() for floats, or AddScaledU8() with the input scale folded into its scale, and the implied 1.0 input for the bias.
+	template <typename INPUT_TYPE, size_t NUM_INPUTS>
+	float AccumulateGradient(std::span<const INPUT_TYPE, NUM_INPUTS> input, int label, std::span<float, c_numWeights> gradientSum, float weight) const
+	{
+		// We use a thread local stack allocator to get rid of allocation cost of local arrays.
+		thread_local StackPoolAllocator<float> allocator(
+			c_hiddenActivationStride +					// hiddenLayerActivations
+			c_numOutputNeurons + 1 +					// outputLayerActivations
+			c_numOutputNeurons +						// OutputLayer_deltaCost_deltaZ
+			c_numHiddenNeurons							// HiddenLayer_deltaCost_deltaZ
+		);
+		allocator.Reset();
+
+		// Evaluate the hidden layer
+		auto hiddenLayerActivations = EvaluateHiddenLayer(input, allocator);
+
+		// The cost function of the total network that we want to minimize is the sum of the cost function of each output neuron.
+		// 
+		// The cost function of a single neuron is going to be 1/2 (desiredOutput - output)^2.
+		// The 1/2 is there so that the derivative of the cost function (deltaCost/deltaOutput) is output - desiredOutput.
+		// 
+		// In the below:
+		//  * Z is the output of that neuron before the activation function (the sum of the weighted inputs).
+		//  * O ("oh") is Z put through the activation function, and is the neuron output value.
+
+		// Evaluate the output layer, add the weighted output layer derivatives into gradientSum, and get deltaCost/deltaZ for the hidden neurons
+		float cost = 0.0f;
+		auto HiddenLayer_deltaCost_deltaZ = AccumulateOutputLayerGradient(hiddenLayerActivations, label, gradientSum, allocator, weight, &cost);
+
+		// Hidden Layer Part 2
+		// 
+		// Calculate deltaCost/deltaWeight for each weight going into the hidden neuron
+		// 
+		// deltaCost/deltaWeight = deltaCost/deltaZ * deltaZ/deltaWeight
+		// 
+		// deltaZ/deltaWeight is the input layer value that goes with each weight, since the weights and inputs are multiplied together before being summed.
+		// 
+		// deltaCost/deltaWeight = deltaCost/deltaBias * input
+		//
+		// The derivatives are added into the hidden layer part of gradientSum, with deltaCost/deltaBias after each neuron's weights.
+		const SIMDKernels& kernels = GetSIMDKernels();
+		for (size_t hiddenNeuronIndex = 0; hiddenNeuronIndex < c_numHiddenNeurons; ++hiddenNeuronIndex)
+		{
+			float* gradientRow = &gradientSum[hiddenNeuronIndex * (c_numInputNeurons + 1)];
+			if constexpr (std::is_same_v<INPUT_TYPE, uint8_t>)
+			{
+				kernels.AddScaledU8(gradientRow, input.data(), HiddenLayer_deltaCost_deltaZ[hiddenNeuronIndex] * c_uint8InputScale, c_numInputNeurons);
+				gradientRow[c_numInputNeurons] += HiddenLayer_deltaCost_deltaZ[hiddenNeuronIndex];
+			}
+			else
+			{
+				// The last input is the 1.0 for the bias term, so this also adds deltaCost/deltaBias
+				kernels.AddScaled(gradientRow, input.data(), HiddenLayer_deltaCost_deltaZ[hiddenNeuronIndex], c_numInputNeurons + 1);
+			}
+		}
+
+		return cost;
+	}
+
+	// Shared by the versions of backprop that add into a gradient sum.
+	// Given the hidden layer activations (with the 1.0 for the bias term at the end), this evaluates the output layer,
+	// adds the derivatives of the output layer weights into gradientSum, and returns deltaCost/deltaZ for each hidden neuron.
+	// The derivatives are multiplied by weight, and if cost isn't null, the cost of the item is written to it.
+	// AccumulateGradient() has the start of the explanation of the math.
+	std::span<float, c_numHiddenNeurons> AccumulateOutputLayerGradient(std::span<const float, c_numHiddenNeurons + 1> hiddenLayerActivations, int label, std::span<float, c_numWeights> gradientSum, StackPoolAllocator<float>& allocator, float weight = 1.0f, float* cost = nullptr) const
+	{
+		const SIMDKernels& kernels = GetSIMDKernels();
+
+		// Evaluate the output layer
+		auto outputLayerActivations = EvaluateOutputLayer(hiddenLayerActivations, allocator);
+
+		// Output Layer Part 1
+		// 
+		// Calculate deltaCost/deltaZ for each output neuron.
+		// This is also deltaCost/deltaBias since changing the bias changes Z directly, 1:1.
+		//
+		// deltaCost/deltaZ = deltaCost/deltaO * deltaO/deltaZ
+		//
+		// deltaCost/deltaO = O - desiredOutput
+		// 
+		// deltaO/deltaZ = O * (1 - O)
+		//
+		// The cost of the item is the sum of the cost of each output neuron.
+		auto OutputLayer_deltaCost_deltaZ = allocator.Allocate<c_numOutputNeurons, false>();
+		float totalCost = 0.0f;
+		for (int outputNeuronIndex = 0; outputNeuronIndex < c_numOutputNeurons; ++outputNeuronIndex)
+		{
+			float desiredOutput = (outputNeuronIndex == label) ? 1.0f : 0.0f;
+			float deltaCost_deltaO = outputLayerActivations[outputNeuronIndex] - desiredOutput;
+			float deltaO_deltaZ = outputLayerActivations[outputNeuronIndex] * (1.0f - outputLayerActivations[outputNeuronIndex]);
+			OutputLayer_deltaCost_deltaZ[outputNeuronIndex] = deltaCost_deltaO * deltaO_deltaZ * weight;
+			totalCost += 0.5f * deltaCost_deltaO * deltaCost_deltaO;
+		}
+		if (cost)
+			*cost = totalCost;
+
+		// Output Layer Part 2
+		//
+		// Calculate deltaCost/deltaWeight for each weight going into each output neuron
+		// 
+		// deltaCost/deltaWeight = deltaCost/deltaZ * deltaZ/deltaWeight
+		//
+		// deltaZ/deltaWeight is the hidden layer activation that goes with each weight, since the weights and activations are multiplied together before being summed.
+		// 
+		// deltaCost/deltaWeight = deltaCost/deltaZ * hiddenLayerActivation
+		//
+		// The last hidden layer activation is the 1.0 for the bias term, so this also adds deltaCost/deltaBias.
+		for (size_t outputNeuronIndex = 0; outputNeuronIndex < c_numOutputNeurons; ++outputNeuronIndex)
+			kernels.AddScaled(&gradientSum[c_numHiddenWeights + outputNeuronIndex * (c_numHiddenNeurons + 1)], hiddenLayerActivations.data(), OutputLayer_deltaCost_deltaZ[outputNeuronIndex], c_numHiddenNeurons + 1);
+
+		// Hidden Layer Part 1
+		// 
+		// Calculate deltaCost/deltaZ for each hidden neuron.
+		// This is also deltaCost/deltaBias since changing the bias changes Z directly, 1:1.
+		// 
+		// Each hidden layer neuron contributes to the error of each output neuron, so we need to sum them up the error from all of those paths.
+		// 
+		// Each path has a deltaCost/deltaO of deltaCost/deltaOutputZ * deltaOutputZ/deltaO.
+		// 
+		// Getting the deltaCost/deltaO of the entire neuron means summing up each path.
+		// 
+		// deltaCost/deltaO = Sum( deltaCost/deltaOutputZ * deltaOutputZ/deltaO )
+		// 
+		// deltaCost/deltaOutputZ is already calculated as OutputLayer_deltaCost_deltaZ.
+		// 
+		// deltaOutputZ/deltaO is the value of the weight connecting the hidden and output neuron, the output is multiplied by that weight for that output neuron.
+		// We read those weights from m_outputWeightsTransposed, where the weights coming out of a hidden neuron are next to each other in memory.
+		//
+		auto HiddenLayer_deltaCost_deltaZ = allocator.Allocate<c_numHiddenNeurons, false>();
+		for (int hiddenNeuronIndex = 0; hiddenNeuronIndex < c_numHiddenNeurons; ++hiddenNeuronIndex)
+		{
+			float deltaCost_deltaO = DotProduct(OutputLayer_deltaCost_deltaZ.data(), &m_outputWeightsTransposed[hiddenNeuronIndex * c_numOutputNeurons], c_numOutputNeurons);
+			float deltaO_deltaZ = hiddenLayerActivations[hiddenNeuronIndex] * (1.0f - hiddenLayerActivations[hiddenNeuronIndex]);
+			HiddenLayer_deltaCost_deltaZ[hiddenNeuronIndex] = deltaCost_deltaO * deltaO_deltaZ;
+		}
+
+		return HiddenLayer_deltaCost_deltaZ;
+	}
+
 	template <typename T, typename U, size_t NUM_ACTIVATIONS, size_t NUM_WEIGHTS>
 	inline std::span<const T, NUM_WEIGHTS / NUM_ACTIVATIONS + 1> EvaluateLayer(const std::span<const U, NUM_ACTIVATIONS>& activations, const std::span<const T, NUM_WEIGHTS>& weights, StackPoolAllocator<T>& allocator) const
 	{
@@ -316,10 +752,128 @@ private:
 		return ret;
 	}
 
+	// The float versions use the weights in the internal layout, and the SIMD kernels, which do several neurons at once.
+	// The activations passed in have the 1.0 for the bias term at the end like above, but it isn't read, since the biases are separate.
+	// The kernels read the activations up to the row stride, so the hidden layer activations are returned in a buffer that is
+	// zero padded to c_hiddenActivationStride, and the inputs are copied into a zero padded buffer if the row stride is past their end.
+	std::span<const float, c_numHiddenNeurons + 1> EvaluateHiddenLayer(std::span<const float, c_numInputNeurons + 1> input, StackPoolAllocator<float>& allocator) const
+	{
+		const float* activations = input.data();
+		if constexpr (c_hiddenRowStride > c_numInputNeurons + 1)
+		{
+			thread_local AlignedVector<float> paddedInput(c_hiddenRowStride, 0.0f);
+			std::copy(input.begin(), input.end(), paddedInput.begin());
+			activations = paddedInput.data();
+		}
+		return EvaluateLayer<c_numHiddenNeurons, c_hiddenActivationStride>(activations, m_hiddenWeights.data(), c_hiddenRowStride, m_hiddenBiases.data(), allocator);
+	}
+
+	std::span<const float, c_numHiddenNeurons + 1> EvaluateHiddenLayer(std::span<const uint8_t, c_numInputNeurons> input, StackPoolAllocator<float>& allocator) const
+	{
+		const uint8_t* activations = input.data();
+		if constexpr (c_hiddenRowStride > c_numInputNeurons)
+		{
+			thread_local AlignedVector<uint8_t> paddedInput(c_hiddenRowStride, 0);
+			std::copy(input.begin(), input.end(), paddedInput.begin());
+			activations = paddedInput.data();
+		}
+
+		auto ret = allocator.Allocate<c_hiddenActivationStride, false>();
+		GetSIMDKernels().EvaluateLayerU8(m_hiddenWeights.data(), c_hiddenRowStride, m_hiddenBiases.data(), activations, c_uint8InputScale, c_numHiddenNeurons, ret.data());
+		Sigmoid::Evaluate(ret.data(), c_numHiddenNeurons);
+
+		// An extra activation value for the bias term of the next layer, and then the padding
+		ret[c_numHiddenNeurons] = 1.0f;
+		std::fill(ret.begin() + c_numHiddenNeurons + 1, ret.end(), 0.0f);
+		return ret.template first<c_numHiddenNeurons + 1>();
+	}
+
+	// hiddenLayerActivations must be in a buffer that is zero padded to c_hiddenActivationStride, like EvaluateHiddenLayer() returns
+	std::span<const float, c_numOutputNeurons + 1> EvaluateOutputLayer(std::span<const float, c_numHiddenNeurons + 1> hiddenLayerActivations, StackPoolAllocator<float>& allocator) const
+	{
+		return EvaluateLayer<c_numOutputNeurons>(hiddenLayerActivations.data(), m_outputWeights.data(), c_outputRowStride, m_outputBiases.data(), allocator);
+	}
+
+	// BUFFER_SIZE is how many floats to allocate for the activations. Any past the 1.0 for the bias term are set to zero.
+	template <size_t NUM_NEURONS, size_t BUFFER_SIZE = NUM_NEURONS + 1>
+	inline std::span<const float, NUM_NEURONS + 1> EvaluateLayer(const float* activations, const float* weights, size_t rowStride, const float* biases, StackPoolAllocator<float>& allocator) const
+	{
+		auto ret = allocator.Allocate<BUFFER_SIZE, false>();
+		GetSIMDKernels().EvaluateLayer(weights, rowStride, biases, activations, NUM_NEURONS, ret.data());
+		Sigmoid::Evaluate(ret.data(), NUM_NEURONS);
+
+		// An extra activation value for the bias term of the next layer, and then the padding
+		ret[NUM_NEURONS] = 1.0f;
+		std::fill(ret.begin() + NUM_NEURONS + 1, ret.end(), 0.0f);
+		return ret.template first<NUM_NEURONS + 1>();
+	}
+
+	// The DualNumberN version of a layer. The weights are floats in the internal layout, and firstLayerWeight is the packed index of
+	// the first weight of the layer. The weights in [firstSeededWeight, firstSeededWeight + K) have a dual of 1 in lane (index - firstSeededWeight).
+	// Each neuron is the sum of weight * activation as usual, and then the derivative of that with respect to each seeded weight in its row,
+	// which is the activation the weight multiplies, is added to the weight's lane. The activations have the 1.0 for the bias term at the end.
+	template <typename T, size_t NUM_NEURONS, typename U>
+	inline std::span<const T, NUM_NEURONS + 1> EvaluateLayerSeeded(const U* activations, size_t numActivations, const float* weights, size_t rowStride, const float* biases, size_t firstLayerWeight, size_t firstSeededWeight, StackPoolAllocator<T>& allocator) const
+	{
+		auto ret = allocator.Allocate<NUM_NEURONS + 1, false>();
+		for (size_t neuronIndex = 0; neuronIndex < NUM_NEURONS; ++neuronIndex)
+		{
+			const float* weightRow = &weights[neuronIndex * rowStride];
+
+			// Float activations have no duals, so the float dot product can be used
+			T Z;
+			if constexpr (std::is_same_v<U, float>)
+			{
+				Z = T(DotProduct(weightRow, activations, numActivations) + biases[neuronIndex]);
+			}
+			else
+			{
+				Z = T(biases[neuronIndex]);
+				for (size_t activationIndex = 0; activationIndex < numActivations; ++activationIndex)
+					Z += weightRow[activationIndex] * activations[activationIndex];
+			}
+
+			// The row is the neuron's weights and then its bias in the packed layout
+			size_t rowBegin = firstLayerWeight + neuronIndex * (numActivations + 1);
+			size_t seededBegin = std::max(rowBegin, firstSeededWeight);
+			size_t seededEnd = std::min(rowBegin + numActivations + 1, firstSeededWeight + T::c_numLanes);
+			for (size_t weightIndex = seededBegin; weightIndex < seededEnd; ++weightIndex)
+			{
+				const U& activation = activations[weightIndex - rowBegin];
+				if constexpr (std::is_same_v<U, float>)
+					Z.m_dual[weightIndex - firstSeededWeight] += activation;
+				else
+					Z.m_dual[weightIndex - firstSeededWeight] += activation.m_real;
+			}
+
+			ret[neuronIndex] = ActivationFunction(Z);
+		}
+
+		// An extra activation value for the bias term of the next layer
+		ret[NUM_NEURONS] = T(1.0f);
+		return ret;
+	}
+
+	// For DualNumber this returns an expression, which scales the duals of x when it is assigned.
+	// EvaluateLayer() assigns it back to the same number, which does that in place.
 	template <typename T>
-	inline static T ActivationFunction(T x)
+	inline static auto ActivationFunction(const T& x)
 	{
-		return 1.0f / (1.0f + std::exp(-x));
+		if constexpr (std::is_same_v<T, float>)
+		{
+			return Sigmoid::Evaluate(x);
+		}
+		else
+		{
+			// The derivative of the sigmoid is sigmoid(x) * (1 - sigmoid(x)), so the sigmoid only needs to be calculated once,
+			// for the real part, instead of building it out of dual number exp, add and divide.
+			float s = Sigmoid::Evaluate(x.m_real);
+			float deltaS_deltaX = s * (1.0f - s);
+			if constexpr (std::is_same_v<T, DualNumber>)
+				return DualUnaryExpression<T>(x, s, deltaS_deltaX);
+			else
+				return T::ChainRule(x, s, deltaS_deltaX);
+		}
 	}
 
 	template <typename T, typename U>
@@ -331,11 +885,23 @@ private:
 		return ret;
 	}
 
-	template <typename T>
-	inline static T Lerp(const T& A, const T& B, float t)
+	inline static float DotProduct(const float* A, const float* B, size_t N)
 	{
-		return A * (1.0f - t) + B * t;
+		return GetSIMDKernels().DotProduct(A, B, N);
 	}
 
-	std::vector<float> m_weights;
+	// For dual numbers, A and B can be expressions, and this returns an expression
+	template <typename A, typename B>
+	inline static auto Lerp(const A& a, const B& b, float t)
+	{
+		return a * (1.0f - t) + b * t;
+	}
+
+	// The weights in the internal layout. See c_hiddenRowStride.
+	AlignedVector<float> m_hiddenWeights;		// [hiddenNeuronIndex * c_hiddenRowStride + inputNeuronIndex]
+	AlignedVector<float> m_hiddenBiases;		// [hiddenNeuronIndex]
+	AlignedVector<float> m_outputWeights;		// [outputNeuronIndex * c_outputRowStride + hiddenNeuronIndex]
+	AlignedVector<float> m_outputBiases;		// [outputNeuronIndex]
+
+	std::vector<float> m_outputWeightsTransposed;	// [hiddenNeuronIndex * c_numOutputNeurons + outputNeuronIndex], no biases
 };
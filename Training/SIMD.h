@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////////
+//             Machine Learning Introduction For Game Developers             //
+//         Copyright (c) 2023 Electronic Arts Inc. All rights reserved.      //
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Hand vectorized float versions of the inner loops of the neural network.
+// There is a version of each kernel per instruction set, and the best one the CPU supports is chosen at startup using CPUID,
+// so that the same executable runs on older and newer machines. The scalar versions are the reference implementation.
+
+enum class SIMDLevel
+{
+	Scalar,
+	SSE42,
+	AVX2,		// AVX2 + FMA
+	AVX512,		// AVX-512F
+
+	Count
+};
+
+struct SIMDKernels
+{
+	SIMDLevel level;
+	const char* name;
+
+	// Returns the sum of A[i] * B[i]
+	float (*DotProduct)(const float* A, const float* B, size_t N);
+
+	// Does a vector by matrix multiply: Z[i] = DotProduct(&weights[i * rowStride], activations, rowStride) + biases[i].
+	// Multiple rows are done at once so each activation value is only loaded once for several neurons.
+	// The whole padded row is used, like the internal layout in NN.h: weights is 64 byte aligned, rowStride is a multiple of 16, and the
+	// weights past the real activations in each row are zero. The SIMD versions use aligned loads for the weights, with no tail.
+	// The activations must be readable up to rowStride, and any past the real ones must be finite, like 0, so they add nothing.
+	// This also goes for EvaluateLayerBatch and EvaluateLayerU8 below.
+	void (*EvaluateLayer)(const float* weights, size_t rowStride, const float* biases, const float* activations, size_t numNeurons, float* Z);
+
+	// dest[i] += src[i] * scale
+	void (*AddScaled)(float* dest, const float* src, float scale, size_t N);
+
+	// Batched versions of EvaluateLayer and AddScaled, for a batch of numItems items, which are the matrix-matrix multiplies of batched backprop.
+	// EvaluateLayerBatch does Z[item * zStride + i] = DotProduct(&weights[i * rowStride], activations[item], rowStride) + biases[i].
+	// The items are done 4 at a time, so each weight row is loaded once per 4 items, instead of once per item.
+	// AddScaledBatch does dest[i] += Sum(src[item][i] * scales[item]). Each part of dest is loaded and stored once, for all of the items.
+	void (*EvaluateLayerBatch)(const float* weights, size_t rowStride, const float* biases, const float* const* activations, size_t numItems, size_t numNeurons, float* Z, size_t zStride);
+	void (*AddScaledBatch)(float* dest, const float* const* src, const float* scales, size_t numItems, size_t N);
+
+	// Sparse versions of DotProduct and AddScaled, which only touch the N elements listed in indices.
+	// For SparseAddScaled, the indices must all be different.
+	float (*SparseDotProduct)(const float* A, const float* B, const uint16_t* indices, size_t N);
+	void (*SparseAddScaled)(float* dest, const float* src, const uint16_t* indices, float scale, size_t N);
+
+	// Versions of EvaluateLayer and AddScaled where the activations are 8 bit values, which are converted to floats in registers and
+	// multiplied by activationScale / scale. This is for training on 8 bit pixels without expanding them to floats in memory first.
+	// EvaluateLayerU8 does Z[i] = DotProduct(&weights[i * rowStride], activations, rowStride) * activationScale + biases[i].
+	void (*EvaluateLayerU8)(const float* weights, size_t rowStride, const float* biases, const uint8_t* activations, float activationScale, size_t numNeurons, float* Z);
+	void (*AddScaledU8)(float* dest, const uint8_t* src, float scale, size_t N);
+
+	// values[i] = sigmoid(values[i]), in place. One per accuracy tier in Sigmoid.h, which has the scalar versions and explains the math.
+	// There is no vector std::exp, so SigmoidExact is a scalar loop at every level. It is here so that all the tiers can be used the same way.
+	void (*SigmoidExact)(float* values, size_t N);
+	void (*SigmoidPolyExp)(float* values, size_t N);
+	void (*SigmoidRationalTanh)(float* values, size_t N);
+};
+
+// Returns the highest SIMD level that both the CPU and the OS support
+SIMDLevel GetSupportedSIMDLevel();
+
+// Returns the kernels for a specific SIMD level. The level must be supported by the CPU.
+const SIMDKernels& GetSIMDKernels(SIMDLevel level);
+
+// Returns the best kernels for this CPU. This is decided once, the first time it's called.
+inline const SIMDKernels& GetSIMDKernels()
+{
+	static const SIMDKernels& kernels = GetSIMDKernels(GetSupportedSIMDLevel());
+	return kernels;
+}
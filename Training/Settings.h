@@ -10,29 +10,168 @@
 #define TRAIN_FORWARD_DIFF() false
 #define TRAIN_CENTRAL_DIFF() false
 #define TRAIN_DUAL_NUMBERS() false
+#define TRAIN_DUAL_NUMBERS_CHUNKED() false // Dual numbers with a fixed number of duals, getting the gradient a chunk of weights at a time, with the chunks split across threads
+#define TRAIN_SPARSE_DUAL_NUMBERS() false // Dual numbers that store a sorted list of the duals that aren't 0, instead of every dual between the lowest and highest one
+#define TRAIN_TAPE() false // Reverse mode automatic differentiation, recording the math of the network evaluation on a tape, and going backwards over it
 #define TRAIN_BACKPROP() true
+#define TRAIN_BACKPROP_BATCHED() false // Backprop, but doing a whole mini batch at once as matrix-matrix multiplies
+#define TRAIN_BACKPROP_PARALLEL() false // Batched backprop, on several mini batches at once, split across threads
+#define TRAIN_BACKPROP_HOGWILD() false // Backprop, with each thread updating the shared weights after every item, with no locks
+#define TRAIN_BACKPROP_SPARSE() false // Backprop, skipping the input pixels that are zero
+#define TRAIN_BACKPROP_COMPACT() false // Backprop, with the training data stored as 8 bit pixels, which are converted to float in the kernels
+#define TRAIN_BACKPROP_STREAMING() false // Compact backprop, with the training data streamed from disk in shards, within a memory budget
+#define TRAIN_BACKPROP_IMPORTANCE() false // Backprop, picking items in proportion to their cost when last trained on, with importance weights to correct the gradient
 
 #define DETERMINISTIC() false
 #define MULTI_THREADED() true
+#define PREFETCH_MINI_BATCHES() false // Gather the next mini batch into a contiguous buffer on another thread, while the current one trains
+#define AUGMENT_TRAINING_DATA() false // Randomly rotate, scale, move and elastically distort the training images on the prefetch threads. Needs PREFETCH_MINI_BATCHES().
+#define ASYNC_EVALUATION() false // Evaluate a copy of the network on another thread at the end of each epoch, while the next epoch trains
+#define EXTRACT_PNGS() false // Save the images as PNGs in Training/ and Testing/ in the data set directory, so you can see what the data looks like
+#define CACHE_DATA_SET() false // Save the converted data set to a binary file, which later runs load instead of converting the MNIST files again
 
-static const size_t c_imageDims = 28;
+#define REPORT_SIGMOID_ACCURACY() false // Print the error of each sigmoid tier in Sigmoid.h against std::exp, before training
+#define BENCHMARK_GRADIENTS() false // Time the gradient of a few items with backprop, each kind of dual number and the tape, and compare them to backprop, before training
+
+#if AUGMENT_TRAINING_DATA() && !PREFETCH_MINI_BATCHES()
+#error "AUGMENT_TRAINING_DATA() needs PREFETCH_MINI_BATCHES(), since the augmentation is done on the prefetch threads"
+#endif
 
 const size_t c_trainingEpochs = 30;	// How many times we go through all of the training data.
 const size_t c_miniBatchSize = 10;	// How many items of the training data we should train against, at a time.
 const float c_learningRate = 3.0f;	// How fast should we travel down the gradient.
+const size_t c_parallelMiniBatches = 4;	// How many mini batches parallel backprop trains on at once, so that there is enough work to split across the threads.
+const float c_targetAccuracy = 95.0f;	// Training reports how long it took to reach this accuracy, to compare training methods.
+const size_t c_prefetchBufferCount = 3;	// How many mini batch buffers the prefetcher rotates through. 2 is double buffering.
+const size_t c_prefetchThreadCount = 2;	// How many threads fill the prefetcher's buffers when augmenting. No more than c_prefetchBufferCount.
+static_assert(c_prefetchThreadCount <= c_prefetchBufferCount, "Each prefetch thread needs a buffer to fill");
+const size_t c_evaluationBatchSize = 64;	// How many testing items are evaluated at once, when measuring the accuracy of the network.
+const size_t c_streamingShardSize = 1000;	// How many training items are in each shard, when streaming the training data.
+const size_t c_streamingMemoryBudget = 16 * 1024 * 1024;	// How many bytes of training items can be in memory at once, when streaming the training data.
+
+const float c_importanceUniformMix = 0.25f; // With importance sampling, the fraction of items picked uniformly instead of by cost. The importance weights are at most 1 / this.
+const size_t c_importanceRebuildInterval = 50; // With importance sampling, how many mini batches are trained between updates of the sampler with their costs.
+
+const float c_augmentMaxRotation = 10.0f; // The most that augmentation rotates an image, in degrees
+const float c_augmentMaxScale = 0.1f; // The most that augmentation scales an image by, as a fraction of its size
+const float c_augmentMaxTranslation = 2.0f; // The most that augmentation moves an image, in pixels
+const float c_augmentElasticAlpha = 34.0f; // How strong the elastic distortion is. 0 turns it off.
+const float c_augmentElasticSigma = 4.0f; // How smooth the elastic distortion is. The sigma of the gaussian that blurs the displacements, in pixels.
+
+const size_t c_dualNumberChunkSize = 32; // How many weights each pass of chunked dual numbers gets the derivatives of. The K of DualNumberN.
+const size_t c_gradientBenchmarkItems = 20; // How many training items BENCHMARK_GRADIENTS() gets the gradient of
 
 const float c_finiteDifferencesEpsilon = 0.01f; // The epsilon used in finite differences
 const size_t c_finiteDifferencesThreadSize = 100; // How many weights should each thread handle when doing finite differences?
 
-// Our neural network has:
+// Which sigmoid the network uses: ExactSigmoid, PolyExpSigmoid or RationalTanhSigmoid. See Sigmoid.h
+using TSigmoid = ExactSigmoid;
+
+// The data sets that can be trained on. They are all in the IDX format of MNIST, with 8 bit grayscale images, and byte labels.
+// Each one lives in its own folder under ../Data/, and the loader checks the IDX headers against the image size and class count here.
+// Note that EMNIST images are stored transposed, compared to the others.
+struct MNISTInfo
+{
+	static constexpr const char* c_name = "MNIST";
+	static constexpr const char* c_directory = "../Data/mnist/";
+	static constexpr const char* c_trainingLabelFileName = "train-labels.idx1-ubyte";
+	static constexpr const char* c_trainingImageFileName = "train-images.idx3-ubyte";
+	static constexpr const char* c_testingLabelFileName = "t10k-labels.idx1-ubyte";
+	static constexpr const char* c_testingImageFileName = "t10k-images.idx3-ubyte";
+	static constexpr size_t c_imageWidth = 28;
+	static constexpr size_t c_imageHeight = 28;
+	static constexpr size_t c_numClasses = 10;
+	static constexpr size_t c_numHiddenNeurons = 30;
+};
+
+struct FashionMNISTInfo
+{
+	static constexpr const char* c_name = "Fashion-MNIST";
+	static constexpr const char* c_directory = "../Data/fashion-mnist/";
+	static constexpr const char* c_trainingLabelFileName = "train-labels-idx1-ubyte";
+	static constexpr const char* c_trainingImageFileName = "train-images-idx3-ubyte";
+	static constexpr const char* c_testingLabelFileName = "t10k-labels-idx1-ubyte";
+	static constexpr const char* c_testingImageFileName = "t10k-images-idx3-ubyte";
+	static constexpr size_t c_imageWidth = 28;
+	static constexpr size_t c_imageHeight = 28;
+	static constexpr size_t c_numClasses = 10;
+	static constexpr size_t c_numHiddenNeurons = 30;
+};
+
+struct KMNISTInfo
+{
+	static constexpr const char* c_name = "KMNIST";
+	static constexpr const char* c_directory = "../Data/kmnist/";
+	static constexpr const char* c_trainingLabelFileName = "train-labels-idx1-ubyte";
+	static constexpr const char* c_trainingImageFileName = "train-images-idx3-ubyte";
+	static constexpr const char* c_testingLabelFileName = "t10k-labels-idx1-ubyte";
+	static constexpr const char* c_testingImageFileName = "t10k-images-idx3-ubyte";
+	static constexpr size_t c_imageWidth = 28;
+	static constexpr size_t c_imageHeight = 28;
+	static constexpr size_t c_numClasses = 10;
+	static constexpr size_t c_numHiddenNeurons = 30;
+};
+
+// Digits, upper case letters, and the lower case letters that don't look like their upper case letter
+struct EMNISTBalancedInfo
+{
+	static constexpr const char* c_name = "EMNIST Balanced";
+	static constexpr const char* c_directory = "../Data/emnist/";
+	static constexpr const char* c_trainingLabelFileName = "emnist-balanced-train-labels-idx1-ubyte";
+	static constexpr const char* c_trainingImageFileName = "emnist-balanced-train-images-idx3-ubyte";
+	static constexpr const char* c_testingLabelFileName = "emnist-balanced-test-labels-idx1-ubyte";
+	static constexpr const char* c_testingImageFileName = "emnist-balanced-test-images-idx3-ubyte";
+	static constexpr size_t c_imageWidth = 28;
+	static constexpr size_t c_imageHeight = 28;
+	static constexpr size_t c_numClasses = 47;
+	static constexpr size_t c_numHiddenNeurons = 100;
+};
+
+// Digits, upper case letters and lower case letters
+struct EMNISTByClassInfo
+{
+	static constexpr const char* c_name = "EMNIST ByClass";
+	static constexpr const char* c_directory = "../Data/emnist/";
+	static constexpr const char* c_trainingLabelFileName = "emnist-byclass-train-labels-idx1-ubyte";
+	static constexpr const char* c_trainingImageFileName = "emnist-byclass-train-images-idx3-ubyte";
+	static constexpr const char* c_testingLabelFileName = "emnist-byclass-test-labels-idx1-ubyte";
+	static constexpr const char* c_testingImageFileName = "emnist-byclass-test-images-idx3-ubyte";
+	static constexpr size_t c_imageWidth = 28;
+	static constexpr size_t c_imageHeight = 28;
+	static constexpr size_t c_numClasses = 62;
+	static constexpr size_t c_numHiddenNeurons = 100;
+};
+
+// Which data set to train on: MNISTInfo, FashionMNISTInfo, KMNISTInfo, EMNISTBalancedInfo or EMNISTByClassInfo
+using TDataSetInfo = MNISTInfo;
+
+static const size_t c_imageWidth = TDataSetInfo::c_imageWidth;
+static const size_t c_imageHeight = TDataSetInfo::c_imageHeight;
+static const size_t c_imagePixels = c_imageWidth * c_imageHeight;
+static const size_t c_numClasses = TDataSetInfo::c_numClasses;
+
+// Our neural network has (for MNIST):
 //  * 784 input neurons.  1 input neuron for each pixel.
 //  * 30 hidden neurons.  To help find how to match input to output.
 //  * 10 output neurons.  To specify the digit 0 to 9.
-using TNeuralNetwork = NeuralNetwork<c_imageDims* c_imageDims, 30, 10>;
+// The shape comes from TDataSetInfo at compile time, so the network code is specialized for it.
+using TNeuralNetwork = NeuralNetwork<c_imagePixels, TDataSetInfo::c_numHiddenNeurons, c_numClasses, TSigmoid>;
+
+using TDualNumberN = DualNumberN<c_dualNumberChunkSize>;
 
 struct DataItem;
+struct CompactDataItem;
 
 std::span<const float, TNeuralNetwork::c_numWeights> GetGradient_FiniteDifferences_Central(TNeuralNetwork& neuralNet, const DataItem& dataItem);
 std::span<const float, TNeuralNetwork::c_numWeights> GetGradient_FiniteDifferences_Forward(TNeuralNetwork& neuralNet, const DataItem& dataItem);
 std::span<const float, TNeuralNetwork::c_numWeights> GetGradient_DualNumbers(TNeuralNetwork& neuralNet, const DataItem& dataItem);
-std::span<const float, TNeuralNetwork::c_numWeights> GetGradient_Backprop(TNeuralNetwork& neuralNet, const DataItem& dataItem);
\ No newline at end of file
+std::span<const float, TNeuralNetwork::c_numWeights> GetGradient_DualNumbersChunked(TNeuralNetwork& neuralNet, const DataItem& dataItem);
+std::span<const float, TNeuralNetwork::c_numWeights> GetGradient_SparseDualNumbers(TNeuralNetwork& neuralNet, const DataItem& dataItem);
+std::span<const float, TNeuralNetwork::c_numWeights> GetGradient_Tape(TNeuralNetwork& neuralNet, const DataItem& dataItem);
+std::span<const float, TNeuralNetwork::c_numWeights> GetGradient_Backprop(TNeuralNetwork& neuralNet, const DataItem& dataItem);
+void AccumulateGradient_Backprop(TNeuralNetwork& neuralNet, const DataItem& dataItem, std::span<float, TNeuralNetwork::c_numWeights> gradientSum);
+void AccumulateGradient_BackpropCompact(TNeuralNetwork& neuralNet, const CompactDataItem& dataItem, std::span<float, TNeuralNetwork::c_numWeights> gradientSum);
+void AccumulateGradient_BackpropSparse(TNeuralNetwork& neuralNet, const DataItem& dataItem, std::span<const uint16_t> nonZeroIndices, std::span<float, TNeuralNetwork::c_numWeights> gradientSum);
+float AccumulateGradient_BackpropWeighted(TNeuralNetwork& neuralNet, const DataItem& dataItem, float weight, std::span<float, TNeuralNetwork::c_numWeights> gradientSum);
+std::span<const float, TNeuralNetwork::c_numWeights> GetGradient_BackpropBatched(TNeuralNetwork& neuralNet, std::span<const DataItem* const> miniBatch);
+std::span<const float, TNeuralNetwork::c_numWeights> GetGradient_BackpropParallel(TNeuralNetwork& neuralNet, std::span<const DataItem* const> miniBatch);
\ No newline at end of file
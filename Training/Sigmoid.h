@@ -0,0 +1,109 @@
+///////////////////////////////////////////////////////////////////////////////
+//             Machine Learning Introduction For Game Developers             //
+//         Copyright (c) 2023 Electronic Arts Inc. All rights reserved.      //
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <stdint.h>
+#include "SIMD.h"
+
+// The sigmoid activation function is 1 / (1 + exp(-x)), and std::exp is slow enough that it shows up when profiling.
+// These are the scalar versions of a few ways of calculating it, from most to least accurate.
+// SIMD.cpp has vectorized versions of the same math, which the neural network uses when it evaluates a whole layer at once.
+
+// The exact sigmoid, using std::exp.
+inline float SigmoidExact(float x)
+{
+	return 1.0f / (1.0f + std::exp(-x));
+}
+
+// exp(x) using the same approach as the Cephes math library:
+// exp(x) = 2^n * exp(r), where n is x / ln(2) rounded to an integer, and r = x - n * ln(2) is in [-ln(2)/2, ln(2)/2].
+// exp(r) is approximated by a polynomial, and 2^n is made by putting n directly into the exponent bits of a float.
+// ln(2) is split into two constants, so that n * ln(2) can be subtracted from x without losing precision.
+// x is clamped so that n stays in the range of a normalized float exponent.
+inline float FastExp(float x)
+{
+	x = std::min(std::max(x, -87.0f), 88.0f);
+
+	float n = std::nearbyint(x * 1.44269504088896341f);
+	float r = x - n * 0.693359375f;
+	r = r - n * -2.12194440e-4f;
+
+	float p = 1.9875691500e-4f;
+	p = p * r + 1.3981999507e-3f;
+	p = p * r + 8.3334519073e-3f;
+	p = p * r + 4.1665795894e-2f;
+	p = p * r + 1.6666665459e-1f;
+	p = p * r + 5.0000001201e-1f;
+	p = p * r * r + r + 1.0f;
+
+	float scale = std::bit_cast<float>((int32_t(n) + 127) << 23);
+	return p * scale;
+}
+
+// The sigmoid using FastExp(). Almost as accurate as the exact version.
+inline float SigmoidPolyExp(float x)
+{
+	return 1.0f / (1.0f + FastExp(-x));
+}
+
+// tanh(x) as a rational polynomial: x * P(x^2) / Q(x^2). These are the coefficients that the Eigen library uses.
+// tanh(x) is 1.0 in float precision by the time x is 9, so x is clamped to [-9, 9].
+inline float FastTanh(float x)
+{
+	x = std::min(std::max(x, -9.0f), 9.0f);
+	float x2 = x * x;
+
+	float p = -2.76076847742355e-16f;
+	p = p * x2 + 2.00018790482477e-13f;
+	p = p * x2 + -8.60467152213735e-11f;
+	p = p * x2 + 5.12229709037114e-08f;
+	p = p * x2 + 1.48572235717979e-05f;
+	p = p * x2 + 6.37261928875436e-04f;
+	p = p * x2 + 4.89352455891786e-03f;
+	p = p * x;
+
+	float q = 1.19825839466702e-06f;
+	q = q * x2 + 1.18534705686654e-04f;
+	q = q * x2 + 2.26843463243900e-03f;
+	q = q * x2 + 4.89352518554385e-03f;
+
+	return p / q;
+}
+
+// The sigmoid using sigmoid(x) = 0.5 + 0.5 * tanh(x / 2).
+// This is the cheapest, but it loses the precision of small outputs, because they come from subtracting two numbers close to 0.5.
+// The rational approximation of tanh can go a little past -1 and 1, so the result is clamped to [0, 1], or a sigmoid output could
+// come out slightly negative.
+inline float SigmoidRationalTanh(float x)
+{
+	return std::min(std::max(0.5f + 0.5f * FastTanh(0.5f * x), 0.0f), 1.0f);
+}
+
+// These are the policies that NeuralNetwork takes as a template parameter to choose which sigmoid it uses.
+// Evaluate(x) does a single value, and Evaluate(values, N) does an array of values in place, using the SIMD kernels.
+struct ExactSigmoid
+{
+	static constexpr const char* c_name = "Exact";
+	static float Evaluate(float x) { return SigmoidExact(x); }
+	static void Evaluate(float* values, size_t N) { GetSIMDKernels().SigmoidExact(values, N); }
+};
+
+struct PolyExpSigmoid
+{
+	static constexpr const char* c_name = "PolyExp";
+	static float Evaluate(float x) { return SigmoidPolyExp(x); }
+	static void Evaluate(float* values, size_t N) { GetSIMDKernels().SigmoidPolyExp(values, N); }
+};
+
+struct RationalTanhSigmoid
+{
+	static constexpr const char* c_name = "RationalTanh";
+	static float Evaluate(float x) { return SigmoidRationalTanh(x); }
+	static void Evaluate(float* values, size_t N) { GetSIMDKernels().SigmoidRationalTanh(values, N); }
+};
@@ -0,0 +1,447 @@
+///////////////////////////////////////////////////////////////////////////////
+//             Machine Learning Introduction For Game Developers             //
+//         Copyright (c) 2023 Electronic Arts Inc. All rights reserved.      //
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <span>
+#include <string.h>
+#include "DualNumber.h"
+
+struct SparseDual
+{
+	int index;
+	float value;
+};
+
+using SparseDualNumberArena = DualArena<SparseDual>;
+
+// The duals are a list of (index, value) pairs sorted by index, stored in the thread's SparseDualNumberArena.
+// Duals that are 0 don't get a pair.
+//
+// DualNumber stores every dual between its lowest and highest dual index. That works well for the hidden layer, where each neuron only
+// has the duals of its own row of weights. But each output neuron adds up every hidden neuron, and their rows are spread across the
+// whole weight array, so the range covers nearly every weight, even though most of the duals in it are 0: the weights of the input
+// pixels that are 0. This only stores the duals that aren't 0, at the cost of storing their indices too, and of merging two lists
+// instead of walking two arrays side by side.
+struct SparseDualNumber
+{
+	SparseDualNumber()
+	{
+	}
+
+	explicit SparseDualNumber(float f)
+	{
+		m_real = f;
+	}
+
+	SparseDualNumber(const SparseDualNumber& d)
+	{
+		m_real = d.m_real;
+		CopyDuals(d);
+	}
+
+	SparseDualNumber(SparseDualNumber&& d) noexcept
+	{
+		m_real = d.m_real;
+		TakeDuals(d);
+	}
+
+	SparseDualNumber& operator = (const SparseDualNumber& d)
+	{
+		if (this != &d)
+		{
+			m_real = d.m_real;
+			CopyDuals(d);
+		}
+		return *this;
+	}
+
+	SparseDualNumber& operator = (SparseDualNumber&& d) noexcept
+	{
+		if (this != &d)
+		{
+			m_real = d.m_real;
+			TakeDuals(d);
+		}
+		return *this;
+	}
+
+	void Reset()
+	{
+		m_real = 0.0f;
+		EmptyDuals();
+	}
+
+	void SetDualValue(int index, float f)
+	{
+		// Find where the index is, or goes, in the sorted list
+		SparseDual* end = m_duals + m_dualCount;
+		SparseDual* it = std::lower_bound(m_duals, end, index, [](const SparseDual& dual, int index) { return dual.index < index; });
+		int position = int(it - m_duals);
+
+		if (it != end && it->index == index)
+		{
+			if (f != 0.0f)
+			{
+				it->value = f;
+			}
+			else
+			{
+				memmove(&m_duals[position], &m_duals[position + 1], sizeof(SparseDual) * (m_dualCount - position - 1));
+				m_dualCount--;
+			}
+		}
+		else if (f != 0.0f)
+		{
+			Reserve(m_dualCount + 1);
+			memmove(&m_duals[position + 1], &m_duals[position], sizeof(SparseDual) * (m_dualCount - position));
+			m_duals[position] = SparseDual{ index, f };
+			m_dualCount++;
+		}
+	}
+
+	float GetDualValue(int index) const
+	{
+		const SparseDual* begin = m_duals;
+		const SparseDual* end = m_duals + m_dualCount;
+		const SparseDual* it = std::lower_bound(begin, end, index, [](const SparseDual& dual, int index) { return dual.index < index; });
+		return (it != end && it->index == index) ? it->value : 0.0f;
+	}
+
+	std::span<const SparseDual> Duals() const
+	{
+		return std::span<const SparseDual>{ m_duals, size_t(m_dualCount) };
+	}
+
+	// Returns f(x), given f and its derivative at the real part of x. By the chain rule, the duals are the duals of x times the derivative.
+	static SparseDualNumber ChainRule(const SparseDualNumber& x, float value, float derivative)
+	{
+		SparseDualNumber ret;
+		ret.m_real = value;
+		ForEachDual(x, ret,
+			[derivative](float AReal, float ADual, float& retDual)
+			{
+				retDual = ADual * derivative;
+			}
+		);
+		return ret;
+	}
+
+	// Merges the duals of A and B. Where only one of them has a dual at an index, the other one's dual there is 0.
+	// The result is written to new storage, so C can be A or B.
+	template <typename LAMBDA>
+	static inline void ForEachDual(const SparseDualNumber& A, const SparseDualNumber& B, SparseDualNumber& C, const LAMBDA& lambda)
+	{
+		int maxCount = A.m_dualCount + B.m_dualCount;
+		SparseDual* result = (maxCount > 0) ? SparseDualNumberArena::ThreadInstance().Allocate(maxCount) : nullptr;
+		int count = 0;
+
+		int positionA = 0;
+		int positionB = 0;
+		while (positionA < A.m_dualCount || positionB < B.m_dualCount)
+		{
+			// Take the lowest index of the two, or both if they are the same
+			int indexA = (positionA < A.m_dualCount) ? A.m_duals[positionA].index : INT_MAX;
+			int indexB = (positionB < B.m_dualCount) ? B.m_duals[positionB].index : INT_MAX;
+			int index = std::min(indexA, indexB);
+			float ADual = (indexA == index) ? A.m_duals[positionA++].value : 0.0f;
+			float BDual = (indexB == index) ? B.m_duals[positionB++].value : 0.0f;
+
+			float resultDual;
+			lambda(A.m_real, ADual, B.m_real, BDual, resultDual);
+			if (resultDual != 0.0f)
+				result[count++] = SparseDual{ index, resultDual };
+		}
+
+		C.m_duals = result;
+		C.m_dualCount = count;
+		C.m_dualCapacity = maxCount;
+	}
+
+	// B can be A
+	template <typename LAMBDA>
+	static inline void ForEachDual(const SparseDualNumber& A, SparseDualNumber& B, const LAMBDA& lambda)
+	{
+		int maxCount = A.m_dualCount;
+		SparseDual* result = (maxCount > 0) ? SparseDualNumberArena::ThreadInstance().Allocate(maxCount) : nullptr;
+		int count = 0;
+
+		for (int position = 0; position < A.m_dualCount; ++position)
+		{
+			float resultDual;
+			lambda(A.m_real, A.m_duals[position].value, resultDual);
+			if (resultDual != 0.0f)
+				result[count++] = SparseDual{ A.m_duals[position].index, resultDual };
+		}
+
+		B.m_duals = result;
+		B.m_dualCount = count;
+		B.m_dualCapacity = maxCount;
+	}
+
+	float m_real = 0.0f;
+	SparseDual* m_duals = nullptr; // In the thread's SparseDualNumberArena
+	int m_dualCount = 0;
+	int m_dualCapacity = 0; // How many pairs there is room for at m_duals
+
+private:
+	void EmptyDuals()
+	{
+		m_duals = nullptr;
+		m_dualCount = 0;
+		m_dualCapacity = 0;
+	}
+
+	void CopyDuals(const SparseDualNumber& d)
+	{
+		EmptyDuals();
+		if (d.m_dualCount == 0)
+			return;
+
+		m_dualCount = d.m_dualCount;
+		m_dualCapacity = d.m_dualCount;
+		m_duals = SparseDualNumberArena::ThreadInstance().Allocate(m_dualCapacity);
+		memcpy(m_duals, d.m_duals, sizeof(SparseDual) * m_dualCount);
+	}
+
+	void TakeDuals(SparseDualNumber& d)
+	{
+		m_duals = d.m_duals;
+		m_dualCount = d.m_dualCount;
+		m_dualCapacity = d.m_dualCapacity;
+		d.EmptyDuals();
+	}
+
+	// Makes room for count pairs, keeping the ones there. It gets twice as much as it had, so appending one at a time isn't quadratic.
+	void Reserve(int count)
+	{
+		if (count <= m_dualCapacity)
+			return;
+
+		int newCapacity = std::max(count, 2 * m_dualCapacity);
+		SparseDual* newDuals = SparseDualNumberArena::ThreadInstance().Allocate(newCapacity);
+		if (m_dualCount > 0)
+			memcpy(newDuals, m_duals, sizeof(SparseDual) * m_dualCount);
+		m_duals = newDuals;
+		m_dualCapacity = newCapacity;
+	}
+
+	// Returns true if every dual of d has a higher index than every dual of this number, so they can be appended without a merge
+	bool CanAppendDuals(const SparseDualNumber& d) const
+	{
+		return d.m_dualCount > 0 && (m_dualCount == 0 || d.m_duals[0].index > m_duals[m_dualCount - 1].index);
+	}
+
+	void AppendDuals(const SparseDualNumber& d, float scale)
+	{
+		Reserve(m_dualCount + d.m_dualCount);
+		for (int position = 0; position < d.m_dualCount; ++position)
+			m_duals[m_dualCount++] = SparseDual{ d.m_duals[position].index, d.m_duals[position].value * scale };
+	}
+
+public:
+	//==================================================
+	// Unary ops
+	//==================================================
+
+	inline SparseDualNumber operator - () const
+	{
+		return ChainRule(*this, -m_real, -1.0f);
+	}
+
+	//==================================================
+	// A (op) B
+	//==================================================
+
+	inline SparseDualNumber operator - (const SparseDualNumber& d) const
+	{
+		SparseDualNumber ret;
+		ret.m_real = m_real - d.m_real;
+		ForEachDual(*this, d, ret,
+			[](float AReal, float ADual, float BReal, float BDual, float& retDual)
+			{
+				retDual = ADual - BDual;
+			}
+		);
+		return ret;
+	}
+
+	inline SparseDualNumber operator + (const SparseDualNumber& d) const
+	{
+		SparseDualNumber ret;
+		ret.m_real = m_real + d.m_real;
+		ForEachDual(*this, d, ret,
+			[](float AReal, float ADual, float BReal, float BDual, float& retDual)
+			{
+				retDual = ADual + BDual;
+			}
+		);
+		return ret;
+	}
+
+	inline SparseDualNumber operator * (const SparseDualNumber& d) const
+	{
+		SparseDualNumber ret;
+		ret.m_real = m_real * d.m_real;
+		ForEachDual(*this, d, ret,
+			[](float AReal, float ADual, float BReal, float BDual, float& retDual)
+			{
+				retDual = (AReal * BDual) + (ADual * BReal);
+			}
+		);
+		return ret;
+	}
+
+	inline SparseDualNumber operator / (const SparseDualNumber& d) const
+	{
+		SparseDualNumber ret;
+		ret.m_real = m_real / d.m_real;
+		ForEachDual(*this, d, ret,
+			[](float AReal, float ADual, float BReal, float BDual, float& retDual)
+			{
+				retDual = (ADual * BReal - AReal * BDual) / (BReal * BReal);
+			}
+		);
+		return ret;
+	}
+
+	//==================================================
+	// A (op =) B
+	// The lambdas read the real part of this number, so it is updated after the duals.
+	// In a dot product of the weights with float activations, each term's duals come after all of the duals of the sum so far,
+	// so += and -= append those in place instead of merging.
+	//==================================================
+
+	inline SparseDualNumber& operator += (const SparseDualNumber& d)
+	{
+		if (CanAppendDuals(d))
+		{
+			AppendDuals(d, 1.0f);
+		}
+		else
+		{
+			ForEachDual(*this, d, *this,
+				[](float AReal, float ADual, float BReal, float BDual, float& retDual)
+				{
+					retDual = ADual + BDual;
+				}
+			);
+		}
+		m_real = m_real + d.m_real;
+		return *this;
+	}
+
+	inline SparseDualNumber& operator -= (const SparseDualNumber& d)
+	{
+		if (CanAppendDuals(d))
+		{
+			AppendDuals(d, -1.0f);
+		}
+		else
+		{
+			ForEachDual(*this, d, *this,
+				[](float AReal, float ADual, float BReal, float BDual, float& retDual)
+				{
+					retDual = ADual - BDual;
+				}
+			);
+		}
+		m_real = m_real - d.m_real;
+		return *this;
+	}
+
+	inline SparseDualNumber& operator *= (const SparseDualNumber& d)
+	{
+		ForEachDual(*this, d, *this,
+			[](float AReal, float ADual, float BReal, float BDual, float& retDual)
+			{
+				retDual = (AReal * BDual) + (ADual * BReal);
+			}
+		);
+		m_real = m_real * d.m_real;
+		return *this;
+	}
+
+	inline SparseDualNumber& operator /= (const SparseDualNumber& d)
+	{
+		ForEachDual(*this, d, *this,
+			[](float AReal, float ADual, float BReal, float BDual, float& retDual)
+			{
+				retDual = (ADual * BReal - AReal * BDual) / (BReal * BReal);
+			}
+		);
+		m_real = m_real / d.m_real;
+		return *this;
+	}
+};
+
+//==================================================
+// float (op) SparseDualNumber
+// SparseDualNumber (op) float
+// A float has duals of zero, so these are all the chain rule on the SparseDualNumber.
+//==================================================
+
+inline SparseDualNumber operator + (float f, const SparseDualNumber& d)
+{
+	SparseDualNumber ret = d;
+	ret.m_real = f + ret.m_real;
+	return ret;
+}
+
+inline SparseDualNumber operator - (float f, const SparseDualNumber& d)
+{
+	return SparseDualNumber::ChainRule(d, f - d.m_real, -1.0f);
+}
+
+inline SparseDualNumber operator * (float f, const SparseDualNumber& d)
+{
+	return SparseDualNumber::ChainRule(d, f * d.m_real, f);
+}
+
+inline SparseDualNumber operator / (float f, const SparseDualNumber& d)
+{
+	return SparseDualNumber::ChainRule(d, f / d.m_real, -f / (d.m_real * d.m_real));
+}
+
+inline SparseDualNumber operator + (const SparseDualNumber& d, float f)
+{
+	SparseDualNumber ret = d;
+	ret.m_real = ret.m_real + f;
+	return ret;
+}
+
+inline SparseDualNumber operator - (const SparseDualNumber& d, float f)
+{
+	SparseDualNumber ret = d;
+	ret.m_real = ret.m_real - f;
+	return ret;
+}
+
+inline SparseDualNumber operator * (const SparseDualNumber& d, float f)
+{
+	return SparseDualNumber::ChainRule(d, d.m_real * f, f);
+}
+
+inline SparseDualNumber operator / (const SparseDualNumber& d, float f)
+{
+	return SparseDualNumber::ChainRule(d, d.m_real / f, 1.0f / f);
+}
+
+//==================================================
+// std:: implementations
+//==================================================
+
+namespace std
+{
+	inline SparseDualNumber exp(const SparseDualNumber& d)
+	{
+		// The derivative of exp(x) is exp(x)
+		float expReal = exp(d.m_real);
+		return SparseDualNumber::ChainRule(d, expReal, expReal);
+	}
+};
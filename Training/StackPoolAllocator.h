@@ -25,6 +25,12 @@ public:
 		m_nextFree = 0;
 	}
 
+	// How many more items can be allocated before it runs out of space
+	inline size_t Remaining() const
+	{
+		return m_storage.size() - m_nextFree;
+	}
+
 	template <size_t COUNT, bool INITIALIZE>
 	inline std::span<T, COUNT> Allocate()
 	{
@@ -0,0 +1,143 @@
+///////////////////////////////////////////////////////////////////////////////
+//             Machine Learning Introduction For Game Developers             //
+//         Copyright (c) 2023 Electronic Arts Inc. All rights reserved.      //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "StreamingDataSet.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdio.h>
+#include <string.h>
+
+StreamingDataSet::StreamingDataSet(const char* labelFileName, const char* imageFileName, size_t shardSize, size_t memoryBudget)
+{
+	m_labelFile.Open(labelFileName);
+	m_imageFile.Open(imageFileName);
+	if (!IsValidDataSet(m_labelFile, m_imageFile) || m_imageFile.ItemCount() == 0)
+		return;
+
+	m_itemCount = m_imageFile.ItemCount();
+	m_shardSize = std::max<size_t>(shardSize, 1);
+	m_shardCount = (m_itemCount + m_shardSize - 1) / m_shardSize;
+
+	// Both window buffers have to fit in the budget. There's always at least one shard per window, even if that goes over the budget.
+	size_t shardBytes = m_shardSize * sizeof(CompactDataItem);
+	m_shardsPerWindow = std::clamp<size_t>(memoryBudget / (c_numBuffers * shardBytes), 1, m_shardCount);
+	if (memoryBudget < c_numBuffers * shardBytes)
+		printf("WARNING: a memory budget of %zu bytes is too small for %zu shards of %zu items. Using %zu bytes.\n", memoryBudget, c_numBuffers, m_shardSize, c_numBuffers * shardBytes);
+	m_windowCount = (m_shardCount + m_shardsPerWindow - 1) / m_shardsPerWindow;
+
+	m_shardOrder.resize(m_shardCount);
+	std::iota(m_shardOrder.begin(), m_shardOrder.end(), 0);
+
+	for (std::vector<CompactDataItem>& buffer : m_buffers)
+		buffer.resize(m_shardsPerWindow * m_shardSize);
+}
+
+StreamingDataSet::~StreamingDataSet()
+{
+	EndEpoch();
+}
+
+void StreamingDataSet::BeginEpoch(std::mt19937& rng)
+{
+	EndEpoch();
+	if (!IsValid())
+		return;
+
+	std::shuffle(m_shardOrder.begin(), m_shardOrder.end(), rng);
+
+	m_loaded.store(0, std::memory_order_relaxed);
+	m_consumed.store(0, std::memory_order_relaxed);
+	m_stop.store(false, std::memory_order_relaxed);
+
+	// The loader shuffles the items within each window with its own rng, seeded from this one, so the order is still deterministic
+	uint32_t seed = rng();
+	m_loader = std::thread([this, seed]() { Load(seed); });
+}
+
+void StreamingDataSet::EndEpoch()
+{
+	if (!m_loader.joinable())
+		return;
+
+	// If the consumer stopped early, the loader could be waiting for a free buffer.
+	// Changing m_consumed wakes it up to see that it should stop.
+	m_stop.store(true, std::memory_order_relaxed);
+	m_consumed.fetch_add(c_numBuffers, std::memory_order_release);
+	m_consumed.notify_one();
+	m_loader.join();
+}
+
+std::span<const CompactDataItem> StreamingDataSet::AcquireWindow()
+{
+	size_t consumed = m_consumed.load(std::memory_order_relaxed);
+	if (consumed >= m_windowCount)
+		return std::span<const CompactDataItem>{};
+
+	size_t loaded = m_loaded.load(std::memory_order_acquire);
+	while (loaded == consumed)
+	{
+		m_loaded.wait(loaded, std::memory_order_acquire);
+		loaded = m_loaded.load(std::memory_order_acquire);
+	}
+
+	size_t bufferIndex = consumed % c_numBuffers;
+	return std::span<const CompactDataItem>{ m_buffers[bufferIndex].data(), m_counts[bufferIndex] };
+}
+
+void StreamingDataSet::ReleaseWindow()
+{
+	m_consumed.fetch_add(1, std::memory_order_release);
+	m_consumed.notify_one();
+}
+
+void StreamingDataSet::Load(uint32_t seed)
+{
+	std::mt19937 rng(seed);
+
+	std::span<const uint8_t> labels = m_labelFile.Data();
+	std::span<const uint8_t> pixels = m_imageFile.Data();
+
+	for (size_t windowIndex = 0; windowIndex < m_windowCount; ++windowIndex)
+	{
+		// Wait for the consumer to release a buffer
+		size_t consumed = m_consumed.load(std::memory_order_acquire);
+		while (windowIndex >= consumed + c_numBuffers)
+		{
+			m_consumed.wait(consumed, std::memory_order_acquire);
+			consumed = m_consumed.load(std::memory_order_acquire);
+		}
+
+		if (m_stop.load(std::memory_order_relaxed))
+			return;
+
+		// Read the window's shards from the files, in the shuffled shard order, then evict them since they won't be read again this epoch
+		size_t bufferIndex = windowIndex % c_numBuffers;
+		std::vector<CompactDataItem>& buffer = m_buffers[bufferIndex];
+		size_t count = 0;
+		size_t shardOrderEnd = std::min((windowIndex + 1) * m_shardsPerWindow, m_shardCount);
+		for (size_t shardOrderIndex = windowIndex * m_shardsPerWindow; shardOrderIndex < shardOrderEnd; ++shardOrderIndex)
+		{
+			size_t itemBegin = m_shardOrder[shardOrderIndex] * m_shardSize;
+			size_t itemEnd = std::min(itemBegin + m_shardSize, m_itemCount);
+			for (size_t itemIndex = itemBegin; itemIndex < itemEnd; ++itemIndex)
+			{
+				CompactDataItem& item = buffer[count++];
+				item.label = labels[itemIndex];
+				memcpy(item.pixels, &pixels[itemIndex * c_imagePixels], c_imagePixels);
+			}
+
+			m_labelFile.EvictItems(itemBegin, itemEnd - itemBegin);
+			m_imageFile.EvictItems(itemBegin, itemEnd - itemBegin);
+		}
+
+		std::shuffle(buffer.begin(), buffer.begin() + count, rng);
+		m_counts[bufferIndex] = count;
+
+		// Hand it to the consumer
+		m_loaded.store(windowIndex + 1, std::memory_order_release);
+		m_loaded.notify_one();
+	}
+}
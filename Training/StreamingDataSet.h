@@ -0,0 +1,76 @@
+///////////////////////////////////////////////////////////////////////////////
+//             Machine Learning Introduction For Game Developers             //
+//         Copyright (c) 2023 Electronic Arts Inc. All rights reserved.      //
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <random>
+#include <span>
+#include <thread>
+#include <vector>
+#include "DataSet.h"
+#include "IDXFile.h"
+
+// Streams training data out of IDX files that are too big to load into memory, as CompactDataItems.
+//
+// The items are split into fixed size shards. Each epoch, the order of the shards is shuffled, and the shards are read in that order
+// into windows of several shards. The items within a window are shuffled together. So, every item is trained on once per epoch, the
+// order is random at the shard level across the whole data set, and random at the item level within each window.
+//
+// There are two window buffers. A loader thread reads the next window from disk and shuffles it, while the training thread trains on
+// the window before it. The window size is the largest that lets both buffers fit in the memory budget, so peak memory for the items
+// is bounded by the budget. Once a shard has been read, its pages of the file are evicted, so the file doesn't build up in memory either.
+//
+// Usage each epoch: BeginEpoch(), then AcquireWindow() / ReleaseWindow() until AcquireWindow() returns an empty span.
+class StreamingDataSet
+{
+public:
+	// shardSize is in items, and memoryBudget is in bytes
+	StreamingDataSet(const char* labelFileName, const char* imageFileName, size_t shardSize, size_t memoryBudget);
+	~StreamingDataSet();
+
+	// False if the files couldn't be opened, or don't match TDataSetInfo
+	bool IsValid() const { return m_itemCount > 0; }
+
+	size_t size() const { return m_itemCount; }
+	size_t ShardCount() const { return m_shardCount; }
+	size_t ShardsPerWindow() const { return m_shardsPerWindow; }
+
+	// Shuffles the shard order and starts loading the first windows. Any epoch still in progress is stopped.
+	void BeginEpoch(std::mt19937& rng);
+
+	// Returns the next window of shuffled items, waiting for the loader if it isn't ready yet. Returns an empty span when the epoch is done.
+	// Only one window can be acquired at a time, and it stays valid until ReleaseWindow() is called.
+	std::span<const CompactDataItem> AcquireWindow();
+
+	// Gives the window from AcquireWindow() back to the loader to fill again
+	void ReleaseWindow();
+
+private:
+	static constexpr size_t c_numBuffers = 2;
+
+	void EndEpoch();
+	void Load(uint32_t seed);
+
+	IDXFile m_labelFile;
+	IDXFile m_imageFile;
+	size_t m_itemCount = 0;
+	size_t m_shardSize = 0;
+	size_t m_shardCount = 0;
+	size_t m_shardsPerWindow = 0;
+	size_t m_windowCount = 0;
+
+	std::vector<size_t> m_shardOrder;
+	std::array<std::vector<CompactDataItem>, c_numBuffers> m_buffers;
+	std::array<size_t, c_numBuffers> m_counts = {};
+
+	// How many windows have been loaded and consumed this epoch. On their own cache lines, like in MiniBatchPrefetcher.
+	alignas(64) std::atomic<size_t> m_loaded = 0;
+	alignas(64) std::atomic<size_t> m_consumed = 0;
+	std::atomic<bool> m_stop = false;
+
+	std::thread m_loader;
+};
@@ -0,0 +1,262 @@
+///////////////////////////////////////////////////////////////////////////////
+//             Machine Learning Introduction For Game Developers             //
+//         Copyright (c) 2023 Electronic Arts Inc. All rights reserved.      //
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cmath>
+#include <span>
+#include <stdint.h>
+#include <vector>
+
+// Reverse mode automatic differentiation, which is what backpropagation is, done for any math written with TapeNumbers.
+//
+// Dual numbers carry the derivatives with respect to every weight forward through the math, which makes every operation cost as much
+// as the number of weights it depends on. A TapeNumber is just a float and the index of a node on the thread's Tape instead. Each
+// operation adds a node to the tape, which records which nodes it was calculated from, and the partial derivatives with respect to
+// them. Once the math is done, one pass backwards over the tape, from the output, applies the chain rule to get the derivative of
+// the output with respect to every node. So getting the whole gradient costs one evaluation plus one backwards pass, like backprop,
+// without having to work out the derivatives by hand.
+//
+// The tape is cleared once per training item. Its storage is kept, so after the first item it does no heap allocations.
+class Tape
+{
+public:
+	static const uint32_t c_noNode = UINT32_MAX;
+
+	static Tape& ThreadInstance()
+	{
+		thread_local Tape tape;
+		return tape;
+	}
+
+	void Reset()
+	{
+		m_nodes.clear();
+	}
+
+	size_t size() const
+	{
+		return m_nodes.size();
+	}
+
+	// Adds a node, and returns its index. A node with no parents is a variable. With one parent, parentB is c_noNode.
+	uint32_t Push(uint32_t parentA = c_noNode, float partialA = 0.0f, uint32_t parentB = c_noNode, float partialB = 0.0f)
+	{
+		uint32_t index = uint32_t(m_nodes.size());
+
+		// Missing parents point back at the node itself with a partial of 0, so that the backwards pass has no branches
+		Node node;
+		node.parents[0] = (parentA == c_noNode) ? index : parentA;
+		node.parents[1] = (parentB == c_noNode) ? index : parentB;
+		node.partials[0] = (parentA == c_noNode) ? 0.0f : partialA;
+		node.partials[1] = (parentB == c_noNode) ? 0.0f : partialB;
+		m_nodes.push_back(node);
+		return index;
+	}
+
+	// Returns the derivative of the output node with respect to every node on the tape, which is called the adjoint of the node.
+	// Every node comes after the nodes it was calculated from, so going backwards from the output, each node's adjoint is complete
+	// by the time it is reached, and it is passed on to the node's parents, multiplied by the partial derivatives.
+	// The span is valid until the next call.
+	std::span<const float> Backward(uint32_t output)
+	{
+		m_adjoints.assign(m_nodes.size(), 0.0f);
+		if (output == c_noNode)
+			return m_adjoints;
+
+		// Nodes after the output can't have been used to calculate it
+		m_adjoints[output] = 1.0f;
+		for (size_t index = size_t(output) + 1; index-- > 0;)
+		{
+			const Node& node = m_nodes[index];
+			float adjoint = m_adjoints[index];
+			m_adjoints[node.parents[0]] += adjoint * node.partials[0];
+			m_adjoints[node.parents[1]] += adjoint * node.partials[1];
+		}
+		return m_adjoints;
+	}
+
+private:
+	struct Node
+	{
+		uint32_t parents[2];
+		float partials[2];
+	};
+
+	std::vector<Node> m_nodes;
+	std::vector<float> m_adjoints;
+};
+
+// A float that records the math done with it on the thread's Tape.
+// Numbers made from floats are constants, which aren't on the tape, so math with only constants doesn't add nodes.
+struct TapeNumber
+{
+	TapeNumber()
+	{
+	}
+
+	explicit TapeNumber(float f)
+	{
+		m_real = f;
+	}
+
+	// Makes a number that derivatives are wanted for, like a weight
+	static TapeNumber Variable(float f)
+	{
+		TapeNumber ret(f);
+		ret.m_node = Tape::ThreadInstance().Push();
+		return ret;
+	}
+
+	// Returns f(x), given f and its derivative at the real part of x.
+	// If the derivative is 0, nothing flows back to x, so the result is a constant. If it's 1, the result can share x's node.
+	static TapeNumber ChainRule(const TapeNumber& x, float value, float derivative)
+	{
+		TapeNumber ret(value);
+		if (x.m_node == Tape::c_noNode || derivative == 0.0f)
+			return ret;
+
+		ret.m_node = (derivative == 1.0f) ? x.m_node : Tape::ThreadInstance().Push(x.m_node, derivative);
+		return ret;
+	}
+
+	// Returns f(A, B), given f and its partial derivatives at the real parts of A and B
+	static TapeNumber ChainRule(const TapeNumber& A, const TapeNumber& B, float value, float partialA, float partialB)
+	{
+		if (A.m_node == Tape::c_noNode || partialA == 0.0f)
+			return ChainRule(B, value, partialB);
+		if (B.m_node == Tape::c_noNode || partialB == 0.0f)
+			return ChainRule(A, value, partialA);
+
+		TapeNumber ret(value);
+		ret.m_node = Tape::ThreadInstance().Push(A.m_node, partialA, B.m_node, partialB);
+		return ret;
+	}
+
+	//==================================================
+	// Unary ops
+	//==================================================
+
+	inline TapeNumber operator - () const
+	{
+		return ChainRule(*this, -m_real, -1.0f);
+	}
+
+	//==================================================
+	// A (op) B
+	//==================================================
+
+	inline TapeNumber operator + (const TapeNumber& d) const
+	{
+		return ChainRule(*this, d, m_real + d.m_real, 1.0f, 1.0f);
+	}
+
+	inline TapeNumber operator - (const TapeNumber& d) const
+	{
+		return ChainRule(*this, d, m_real - d.m_real, 1.0f, -1.0f);
+	}
+
+	inline TapeNumber operator * (const TapeNumber& d) const
+	{
+		return ChainRule(*this, d, m_real * d.m_real, d.m_real, m_real);
+	}
+
+	inline TapeNumber operator / (const TapeNumber& d) const
+	{
+		return ChainRule(*this, d, m_real / d.m_real, 1.0f / d.m_real, -m_real / (d.m_real * d.m_real));
+	}
+
+	//==================================================
+	// A (op =) B
+	// Nodes on the tape never change, so these make a new node like the operators above.
+	//==================================================
+
+	inline TapeNumber& operator += (const TapeNumber& d)
+	{
+		*this = *this + d;
+		return *this;
+	}
+
+	inline TapeNumber& operator -= (const TapeNumber& d)
+	{
+		*this = *this - d;
+		return *this;
+	}
+
+	inline TapeNumber& operator *= (const TapeNumber& d)
+	{
+		*this = *this * d;
+		return *this;
+	}
+
+	inline TapeNumber& operator /= (const TapeNumber& d)
+	{
+		*this = *this / d;
+		return *this;
+	}
+
+	float m_real = 0.0f;
+	uint32_t m_node = Tape::c_noNode;
+};
+
+//==================================================
+// float (op) TapeNumber
+// TapeNumber (op) float
+// A float is a constant, so these are all the chain rule on the TapeNumber.
+//==================================================
+
+inline TapeNumber operator + (float f, const TapeNumber& d)
+{
+	return TapeNumber::ChainRule(d, f + d.m_real, 1.0f);
+}
+
+inline TapeNumber operator - (float f, const TapeNumber& d)
+{
+	return TapeNumber::ChainRule(d, f - d.m_real, -1.0f);
+}
+
+inline TapeNumber operator * (float f, const TapeNumber& d)
+{
+	return TapeNumber::ChainRule(d, f * d.m_real, f);
+}
+
+inline TapeNumber operator / (float f, const TapeNumber& d)
+{
+	return TapeNumber::ChainRule(d, f / d.m_real, -f / (d.m_real * d.m_real));
+}
+
+inline TapeNumber operator + (const TapeNumber& d, float f)
+{
+	return TapeNumber::ChainRule(d, d.m_real + f, 1.0f);
+}
+
+inline TapeNumber operator - (const TapeNumber& d, float f)
+{
+	return TapeNumber::ChainRule(d, d.m_real - f, 1.0f);
+}
+
+inline TapeNumber operator * (const TapeNumber& d, float f)
+{
+	return TapeNumber::ChainRule(d, d.m_real * f, f);
+}
+
+inline TapeNumber operator / (const TapeNumber& d, float f)
+{
+	return TapeNumber::ChainRule(d, d.m_real / f, 1.0f / f);
+}
+
+//==================================================
+// std:: implementations
+//==================================================
+
+namespace std
+{
+	inline TapeNumber exp(const TapeNumber& d)
+	{
+		// The derivative of exp(x) is exp(x)
+		float expReal = exp(d.m_real);
+		return TapeNumber::ChainRule(d, expReal, expReal);
+	}
+};
@@ -6,9 +6,19 @@
 #include <stdio.h>
 #include <numeric>
 #include <chrono>
+#include <future>
+#include <type_traits>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <omp.h>
 #include <direct.h>
 
 #include "DataSet.h"
+#include "MiniBatchPrefetcher.h"
+#include "StreamingDataSet.h"
+#include "ImportanceSampler.h"
 
 #include "Settings.h"
 
@@ -23,20 +33,94 @@ std::mt19937 GetRNG()
 	return rng;
 }
 
-float EvaluateNetworkQuality(const TNeuralNetwork& nn, const DataSet& testingData)
+// How well the network does on the testing data
+struct NetworkQuality
 {
-	int correct = 0;
-	for (const DataItem& item : testingData)
+	static const size_t c_numLabels = TNeuralNetwork::c_numOutputNeurons;
+
+	float accuracyPercent = 0.0f;
+	int incorrect = 0;
+
+	// confusionMatrix[label][predictedLabel] is how many testing items with that label were predicted to be predictedLabel.
+	// The diagonal is the items that were predicted correctly.
+	std::array<std::array<int, c_numLabels>, c_numLabels> confusionMatrix = {};
+
+	// Of the items predicted to be this label, the percentage that really were
+	float PrecisionPercent(size_t label) const
+	{
+		int predicted = 0;
+		for (size_t actualLabel = 0; actualLabel < c_numLabels; ++actualLabel)
+			predicted += confusionMatrix[actualLabel][label];
+		return (predicted > 0) ? 100.0f * float(confusionMatrix[label][label]) / float(predicted) : 0.0f;
+	}
+
+	// Of the items that really were this label, the percentage that were predicted to be
+	float RecallPercent(size_t label) const
 	{
-		int predictedLabel = nn.EvaluateOneHot(item.image);
-		if (predictedLabel == item.label)
-			correct++;
+		int actual = 0;
+		for (size_t predictedLabel = 0; predictedLabel < c_numLabels; ++predictedLabel)
+			actual += confusionMatrix[label][predictedLabel];
+		return (actual > 0) ? 100.0f * float(confusionMatrix[label][label]) / float(actual) : 0.0f;
 	}
 
-	float accuracyPercent = 100.0f * float(correct) / float(testingData.size());
+	void Report() const
+	{
+		printf("Accuracy: %0.2f%% (%i incorrect)\n", accuracyPercent, incorrect);
+	}
+};
 
-	printf("Accuracy: %0.2f%% (%i incorrect)\n", accuracyPercent, int(testingData.size() - correct));
-	return accuracyPercent;
+// Evaluates the network on the testing data, and returns the accuracy, along with the confusion matrix.
+// The testing data is split into batches which are spread across threads, and each batch is evaluated with the batched forward pass.
+// Each thread counts into its own confusion matrix, and those are added together at the end.
+// numThreads is how many threads to spread the batches across, which is 1 when evaluating at the same time as training.
+NetworkQuality EvaluateNetworkQuality(const TNeuralNetwork& nn, const DataSet& testingData, int numThreads = omp_get_max_threads())
+{
+	NetworkQuality ret;
+
+	int batchCount = int((testingData.size() + c_evaluationBatchSize - 1) / c_evaluationBatchSize);
+	#if MULTI_THREADED()
+	#pragma omp parallel num_threads(numThreads)
+	#endif
+	{
+		std::array<std::array<int, NetworkQuality::c_numLabels>, NetworkQuality::c_numLabels> confusionMatrix = {};
+
+		#pragma omp for schedule(dynamic)
+		for (int batchIndex = 0; batchIndex < batchCount; ++batchIndex)
+		{
+			size_t batchBegin = size_t(batchIndex) * c_evaluationBatchSize;
+			size_t batchEnd = std::min(batchBegin + c_evaluationBatchSize, testingData.size());
+
+			const float* inputs[c_evaluationBatchSize];
+			int predictedLabels[c_evaluationBatchSize];
+			for (size_t index = batchBegin; index < batchEnd; ++index)
+				inputs[index - batchBegin] = testingData[index].image;
+
+			nn.EvaluateOneHotBatch<c_evaluationBatchSize>(
+				std::span<const float* const>{ inputs, batchEnd - batchBegin },
+				std::span<int>{ predictedLabels, batchEnd - batchBegin }
+			);
+
+			for (size_t index = batchBegin; index < batchEnd; ++index)
+				confusionMatrix[testingData[index].label][predictedLabels[index - batchBegin]]++;
+		}
+
+		#pragma omp critical
+		{
+			for (size_t label = 0; label < NetworkQuality::c_numLabels; ++label)
+			{
+				for (size_t predictedLabel = 0; predictedLabel < NetworkQuality::c_numLabels; ++predictedLabel)
+					ret.confusionMatrix[label][predictedLabel] += confusionMatrix[label][predictedLabel];
+			}
+		}
+	}
+
+	int correct = 0;
+	for (size_t label = 0; label < NetworkQuality::c_numLabels; ++label)
+		correct += ret.confusionMatrix[label][label];
+
+	ret.accuracyPercent = 100.0f * float(correct) / float(testingData.size());
+	ret.incorrect = int(testingData.size() - correct);
+	return ret;
 }
 
 std::string MakeDurationString(float durationInSeconds)
@@ -76,73 +160,229 @@ std::string MakeDurationString(float durationInSeconds)
 	return ret;
 }
 
-template <typename LAMBDA>
-void Train(const DataSet& trainingData, const DataSet& testingData, LAMBDA GetGradient, const char* name)
+// Tracks how fast a training method is, so that different methods can be compared.
+// Only time spent training is counted, not time spent evaluating the network between epochs.
+struct TrainingStats
 {
-	// Remember when the training started so we can report the time duration later
-	std::chrono::high_resolution_clock::time_point trainingStart = std::chrono::high_resolution_clock::now();
+	double trainingSeconds = 0.0;
+	size_t samplesTrained = 0;
+	double timeToTargetAccuracy = -1.0;
+	size_t samplesToTargetAccuracy = 0;
 
-	std::mt19937 rng = GetRNG();
+	// trainingSecondsAtEpochEnd and samplesTrainedAtEpochEnd are what they were when the evaluated epoch finished, since the evaluation can finish later
+	void OnEpochEvaluated(float accuracy, double trainingSecondsAtEpochEnd, size_t samplesTrainedAtEpochEnd)
+	{
+		if (timeToTargetAccuracy < 0.0 && accuracy >= c_targetAccuracy)
+		{
+			timeToTargetAccuracy = trainingSecondsAtEpochEnd;
+			samplesToTargetAccuracy = samplesTrainedAtEpochEnd;
+		}
+	}
 
-	TNeuralNetwork nn(rng);
-	std::vector<float> gradientSum(TNeuralNetwork::c_numWeights);
+	void Report() const
+	{
+		printf("[Total] %0.0f samples/sec. ", double(samplesTrained) / trainingSeconds);
+		if (timeToTargetAccuracy >= 0.0)
+			printf("Time to %0.1f%%: %s (%zu samples)\n", c_targetAccuracy, MakeDurationString(float(timeToTargetAccuracy)).c_str(), samplesToTargetAccuracy);
+		else
+			printf("Did not reach %0.1f%%\n", c_targetAccuracy);
+	}
+};
+
+// Evaluates the network at the end of each epoch and records its accuracy.
+// With ASYNC_EVALUATION(), the network is copied at the end of the epoch, and the copy is evaluated on another thread while the next
+// epoch trains, which takes the evaluation off of the critical path. Only one evaluation is in flight at a time, and each one is
+// waited for at the end of the next epoch, so the accuracies are still reported and recorded in epoch order.
+// The accuracy is reported on its own line, tagged with the epoch it is for, after the duration line of the epoch that trained
+// while it ran. The evaluation runs on a single thread, so that it doesn't oversubscribe the cores the training is using.
+struct EpochEvaluator
+{
+	EpochEvaluator(const DataSet& testingData, std::vector<float>& epochAccuracy, TrainingStats& stats)
+		: testingData(testingData)
+		, epochAccuracy(epochAccuracy)
+		, stats(stats)
+	{
+	}
 
-	// Make a list of indices in our training data. We'll shuffle this each epoch and then train in that order
-	std::vector<int> trainingOrder(trainingData.size());
-	std::iota(trainingOrder.begin(), trainingOrder.end(), 0);
+	// Call after the epoch's duration line has been printed
+	void OnEpochEnd(const TNeuralNetwork& nn, size_t epoch)
+	{
+		#if ASYNC_EVALUATION()
+			// End this epoch's duration line, and report the previous epoch, whose evaluation has been running while this epoch trained
+			printf("\n");
+			FinishPendingEvaluation();
+
+			pendingEpoch = epoch;
+			pendingTrainingSeconds = stats.trainingSeconds;
+			pendingSamplesTrained = stats.samplesTrained;
+			pendingEvaluation = std::async(std::launch::async,
+				[snapshot = nn, &testingData = testingData]()
+				{
+					return EvaluateNetworkQuality(snapshot, testingData, 1);
+				}
+			);
+		#else
+			NetworkQuality quality = EvaluateNetworkQuality(nn, testingData);
+			quality.Report();
+			epochAccuracy[epoch] = quality.accuracyPercent;
+			stats.OnEpochEvaluated(quality.accuracyPercent, stats.trainingSeconds, stats.samplesTrained);
+		#endif
+	}
 
-	// Each epoch is a training with the entire list of training data
-	std::vector<float> epochAccuracy(c_trainingEpochs);
-	for (size_t epoch = 0; epoch < c_trainingEpochs; ++epoch)
+	// Call after the last epoch, to wait for and report the last evaluation
+	void Flush()
 	{
-		// Remember when the epoch started so we can report the time duration later
-		std::chrono::high_resolution_clock::time_point epochStart = std::chrono::high_resolution_clock::now();
+		#if ASYNC_EVALUATION()
+			FinishPendingEvaluation();
+		#endif
+	}
 
-		// For reporting progress
-		int lastPercent = -1;
+private:
+	#if ASYNC_EVALUATION()
+	void FinishPendingEvaluation()
+	{
+		if (!pendingEvaluation.valid())
+			return;
+
+		NetworkQuality quality = pendingEvaluation.get();
+		printf("[Epoch %i/%i] ", (int)pendingEpoch + 1, (int)c_trainingEpochs);
+		quality.Report();
+		epochAccuracy[pendingEpoch] = quality.accuracyPercent;
+		stats.OnEpochEvaluated(quality.accuracyPercent, pendingTrainingSeconds, pendingSamplesTrained);
+	}
 
-		// randomize the order that we are going to use the training data in, for this epoch
-		std::shuffle(trainingOrder.begin(), trainingOrder.end(), rng);
+	std::future<NetworkQuality> pendingEvaluation;
+	size_t pendingEpoch = 0;
+	double pendingTrainingSeconds = 0.0;
+	size_t pendingSamplesTrained = 0;
+	#endif
 
-		// Do each mini batch
-		size_t trainingIndex = 0;
-		while (trainingIndex < trainingOrder.size())
-		{
-			// Get the summed gradient for a mini batch
-			std::fill(gradientSum.begin(), gradientSum.end(), 0.0f);
+	const DataSet& testingData;
+	std::vector<float>& epochAccuracy;
+	TrainingStats& stats;
+};
 
-			size_t trainingEndIndex = std::min(trainingIndex + c_miniBatchSize, trainingOrder.size());
-			size_t trainingCount = trainingEndIndex - trainingIndex;
-			while (trainingIndex < trainingEndIndex)
-			{
-				std::span < const float, TNeuralNetwork::c_numWeights> gradient = GetGradient(nn, trainingData[trainingOrder[trainingIndex]]);
-				for (size_t index = 0; index < gradient.size(); ++index)
-					gradientSum[index] += gradient[index];
+// Maps a float to an integer so that adjacent floats are adjacent integers, including across zero.
+// The difference of two of these is how many ULPs apart the floats are.
+static int64_t FloatToOrderedInt(float f)
+{
+	int32_t bits = std::bit_cast<int32_t>(f);
+	return (bits < 0) ? int64_t(INT32_MIN) - int64_t(bits) : int64_t(bits);
+}
 
-				trainingIndex++;
+// Reports the max error of each sigmoid tier against the sigmoid calculated with std::exp in double precision.
+// Both the scalar versions and the SIMD kernels are tested, since the kernels use FMA where the CPU has it, and so can round differently.
+// Every 997th float in [-c_range, c_range] is tested, which covers every exponent and many mantissas, in well under a second.
+// The final test accuracy of a training run with each tier is the other half of the data. Change TSigmoid in Settings.h to get it.
+void ReportSigmoidAccuracy()
+{
+	static const float c_range = 20.0f;
+	static const uint32_t c_stride = 997;
 
-				int percent = int(1000.0f * float(trainingIndex) / float(trainingData.size()));
-				if (percent != lastPercent)
-				{
-					lastPercent = percent;
-					printf("\r[Epoch %i/%i] %0.2f%%", (int)epoch + 1, (int)c_trainingEpochs, float(percent) / 10.0f);
-				}
-			}
+	struct Tier
+	{
+		const char* name;
+		float (*scalar)(float);
+		void (*kernel)(float* values, size_t N);
+	};
+	const SIMDKernels& kernels = GetSIMDKernels();
+	const Tier tiers[] =
+	{
+		{ ExactSigmoid::c_name, SigmoidExact, kernels.SigmoidExact },
+		{ PolyExpSigmoid::c_name, SigmoidPolyExp, kernels.SigmoidPolyExp },
+		{ RationalTanhSigmoid::c_name, SigmoidRationalTanh, kernels.SigmoidRationalTanh },
+	};
+
+	// Make the list of values to test, positive and negative
+	std::vector<float> inputs;
+	for (uint32_t bits = 0; bits <= std::bit_cast<uint32_t>(c_range); bits += c_stride)
+	{
+		inputs.push_back(std::bit_cast<float>(bits));
+		inputs.push_back(-std::bit_cast<float>(bits));
+	}
+
+	std::vector<float> reference(inputs.size());
+	for (size_t i = 0; i < inputs.size(); ++i)
+		reference[i] = float(1.0 / (1.0 + std::exp(-double(inputs[i]))));
 
-			// Adjust the weights of the network by the gradient.
-			// Divide the trainingCount to make it an average gradient though, and multiply by the learning rate
-			nn.UpdateWeights(gradientSum, c_learningRate / float(trainingCount));
+	printf("Sigmoid accuracy vs std::exp, %i values in [%0.0f, %0.0f]:\n", (int)inputs.size(), -c_range, c_range);
+	std::vector<float> kernelResults(inputs.size());
+	for (const Tier& tier : tiers)
+	{
+		std::copy(inputs.begin(), inputs.end(), kernelResults.begin());
+		tier.kernel(kernelResults.data(), kernelResults.size());
+
+		int64_t scalarMaxULP = 0;
+		int64_t kernelMaxULP = 0;
+		float maxAbsError = 0.0f;
+		for (size_t i = 0; i < inputs.size(); ++i)
+		{
+			float scalarResult = tier.scalar(inputs[i]);
+			scalarMaxULP = std::max(scalarMaxULP, std::abs(FloatToOrderedInt(scalarResult) - FloatToOrderedInt(reference[i])));
+			kernelMaxULP = std::max(kernelMaxULP, std::abs(FloatToOrderedInt(kernelResults[i]) - FloatToOrderedInt(reference[i])));
+			maxAbsError = std::max(maxAbsError, std::max(std::abs(scalarResult - reference[i]), std::abs(kernelResults[i] - reference[i])));
 		}
 
-		float epochDuration = (float)std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - epochStart).count();
-		printf("\r[Epoch %i/%i] Duration: %s ", (int)epoch + 1, (int)c_trainingEpochs, MakeDurationString(epochDuration).c_str());
-		epochAccuracy[epoch] = EvaluateNetworkQuality(nn, testingData);
+		printf("  %-12s max ULP error: %lli scalar, %lli %s. Max absolute error: %g\n", tier.name, (long long)scalarMaxULP, (long long)kernelMaxULP, kernels.name, maxAbsError);
 	}
+}
 
-	float trainingDuration = (float)std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - trainingStart).count();
-	printf("[Total] Duration %s ", MakeDurationString(trainingDuration).c_str());
-	EvaluateNetworkQuality(nn, testingData);
+// Times getting the gradient of the first few training items with backprop, each kind of dual number, and the tape, on a new network,
+// and compares them to backprop. The automatic differentiation methods get the gradient of the mean squared error over the output neurons,
+// while backprop gets the gradient of half of the summed squared error, so backprop is scaled by 2 / c_numOutputNeurons to match.
+// The time is only the time to get the gradients, not to scale or compare them.
+void BenchmarkGradients(const DataSet& trainingData)
+{
+	struct Method
+	{
+		const char* name;
+		std::span<const float, TNeuralNetwork::c_numWeights> (*GetGradient)(TNeuralNetwork& neuralNet, const DataItem& dataItem);
+		float scale;
+	};
+	const float backpropScale = 2.0f / float(TNeuralNetwork::c_numOutputNeurons);
+	const Method methods[] =
+	{
+		{ "Backprop", GetGradient_Backprop, backpropScale },
+		{ "DualNumber", GetGradient_DualNumbers, 1.0f },
+		{ "DualNumberN", GetGradient_DualNumbersChunked, 1.0f },
+		{ "SparseDualNumber", GetGradient_SparseDualNumbers, 1.0f },
+		{ "TapeNumber", GetGradient_Tape, 1.0f },
+	};
+
+	std::mt19937 rng = GetRNG();
+	TNeuralNetwork nn(rng);
+	const size_t itemCount = std::min(c_gradientBenchmarkItems, trainingData.size());
+
+	std::vector<float> reference(TNeuralNetwork::c_numWeights * itemCount, 0.0f);
+	for (size_t itemIndex = 0; itemIndex < itemCount; ++itemIndex)
+	{
+		std::span<float, TNeuralNetwork::c_numWeights> itemReference{ &reference[itemIndex * TNeuralNetwork::c_numWeights], TNeuralNetwork::c_numWeights };
+		AccumulateGradient_Backprop(nn, trainingData[itemIndex], itemReference);
+		for (float& value : itemReference)
+			value *= backpropScale;
+	}
+
+	printf("Gradients of %i training items, vs backprop:\n", (int)itemCount);
+	for (const Method& method : methods)
+	{
+		double seconds = 0.0;
+		float maxAbsError = 0.0f;
+		for (size_t itemIndex = 0; itemIndex < itemCount; ++itemIndex)
+		{
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			std::span<const float, TNeuralNetwork::c_numWeights> gradient = method.GetGradient(nn, trainingData[itemIndex]);
+			seconds += std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - start).count();
 
+			for (size_t weightIndex = 0; weightIndex < TNeuralNetwork::c_numWeights; ++weightIndex)
+				maxAbsError = std::max(maxAbsError, std::abs(gradient[weightIndex] * method.scale - reference[itemIndex * TNeuralNetwork::c_numWeights + weightIndex]));
+		}
+
+		printf("  %-18s %0.3f ms per item. Max absolute error: %g\n", method.name, 1000.0 * seconds / double(itemCount), maxAbsError);
+	}
+}
+
+void SaveResults(TNeuralNetwork& nn, const std::vector<float>& epochAccuracy, const NetworkQuality& quality, const char* name)
+{
 	// save accuracy as csv
 	{
 		char fileName[256];
@@ -159,6 +399,46 @@ void Train(const DataSet& trainingData, const DataSet& testingData, LAMBDA GetGr
 		fclose(file);
 	}
 
+	// save the confusion matrix of the final network as csv. Rows are the labels, columns are the predicted labels.
+	{
+		char fileName[256];
+		sprintf_s(fileName, "out/%s_Confusion.csv", name);
+
+		FILE* file = nullptr;
+		fopen_s(&file, fileName, "wb");
+
+		fprintf(file, "\"Label \\ Predicted\"");
+		for (size_t predictedLabel = 0; predictedLabel < NetworkQuality::c_numLabels; ++predictedLabel)
+			fprintf(file, ",\"%i\"", (int)predictedLabel);
+		fprintf(file, "\n");
+
+		for (size_t label = 0; label < NetworkQuality::c_numLabels; ++label)
+		{
+			fprintf(file, "\"%i\"", (int)label);
+			for (size_t predictedLabel = 0; predictedLabel < NetworkQuality::c_numLabels; ++predictedLabel)
+				fprintf(file, ",\"%i\"", quality.confusionMatrix[label][predictedLabel]);
+			fprintf(file, "\n");
+		}
+
+		fclose(file);
+	}
+
+	// save the precision and recall of each label as csv
+	{
+		char fileName[256];
+		sprintf_s(fileName, "out/%s_PrecisionRecall.csv", name);
+
+		FILE* file = nullptr;
+		fopen_s(&file, fileName, "wb");
+
+		fprintf(file, "\"Label\",\"Precision\",\"Recall\"\n");
+
+		for (size_t label = 0; label < NetworkQuality::c_numLabels; ++label)
+			fprintf(file, "\"%i\",\"%f\",\"%f\"\n", (int)label, quality.PrecisionPercent(label), quality.RecallPercent(label));
+
+		fclose(file);
+	}
+
 	// Save the weights as csv
 	{
 		char fileName[256];
@@ -197,36 +477,387 @@ void Train(const DataSet& trainingData, const DataSet& testingData, LAMBDA GetGr
 		fclose(file);
 	}
 
-	// Save the weights as binary
+	// Save the weights as binary, in the packed layout that the demo reads
 	{
 		char fileName[256];
 		sprintf_s(fileName, "out/%s_Weights.bin", name);
 
+		std::vector<float> weights(TNeuralNetwork::c_numWeights);
+		nn.ExportWeights(std::span<float, TNeuralNetwork::c_numWeights>{ weights.data(), TNeuralNetwork::c_numWeights });
+
 		FILE* file = nullptr;
 		fopen_s(&file, fileName, "wb");
-		fwrite(&nn.GetWeight(0), sizeof(float), TNeuralNetwork::c_numWeights, file);
+		fwrite(weights.data(), sizeof(float), TNeuralNetwork::c_numWeights, file);
 		fclose(file);
 	}
 }
 
+// Gradient functions either take a single data item, or a whole mini batch as a span of data item pointers.
+// The single data item ones either return the gradient, or add it into a gradient sum that is passed in.
+// The data items are DataItems, or CompactDataItems when training on the compact data set.
+template <typename LAMBDA, typename DATA_ITEM>
+static constexpr bool c_isMiniBatchGradient = std::is_invocable_v<LAMBDA, TNeuralNetwork&, std::span<const DATA_ITEM* const>>;
+
+template <typename LAMBDA, typename DATA_ITEM>
+static constexpr bool c_isAccumulatingGradient = std::is_invocable_v<LAMBDA, TNeuralNetwork&, const DATA_ITEM&, std::span<float, TNeuralNetwork::c_numWeights>>;
+
+// Trains the network on one mini batch of trainingCount items, where MiniBatchItem(index) returns the index'th item.
+// gradientSum and miniBatch are scratch space, sized for a full mini batch.
+template <typename DATA_ITEM, typename LAMBDA, typename MINI_BATCH_ITEM>
+void TrainMiniBatch(TNeuralNetwork& nn, LAMBDA& GetGradient, MINI_BATCH_ITEM& MiniBatchItem, size_t trainingCount, float learningRate, std::vector<float>& gradientSum, std::vector<const DATA_ITEM*>& miniBatch)
+{
+	// If the gradient function can take a whole mini batch at once, give it the mini batch and let it sum the gradient
+	if constexpr (c_isMiniBatchGradient<LAMBDA, DATA_ITEM>)
+	{
+		for (size_t index = 0; index < trainingCount; ++index)
+			miniBatch[index] = &MiniBatchItem(index);
+
+		std::span<const float, TNeuralNetwork::c_numWeights> gradient = GetGradient(nn, std::span<const DATA_ITEM* const>{ miniBatch.data(), trainingCount });
+
+		// Adjust the weights of the network by the gradient.
+		// Divide the trainingCount to make it an average gradient though, and multiply by the learning rate
+		nn.UpdateWeights(gradient, learningRate / float(trainingCount));
+	}
+	// Otherwise, get the summed gradient for a mini batch one item at a time
+	else
+	{
+		std::fill(gradientSum.begin(), gradientSum.end(), 0.0f);
+
+		for (size_t index = 0; index < trainingCount; ++index)
+		{
+			if constexpr (c_isAccumulatingGradient<LAMBDA, DATA_ITEM>)
+			{
+				GetGradient(nn, MiniBatchItem(index), std::span<float, TNeuralNetwork::c_numWeights>{ gradientSum.data(), TNeuralNetwork::c_numWeights });
+			}
+			else
+			{
+				std::span < const float, TNeuralNetwork::c_numWeights> gradient = GetGradient(nn, MiniBatchItem(index));
+				for (size_t weightIndex = 0; weightIndex < gradient.size(); ++weightIndex)
+					gradientSum[weightIndex] += gradient[weightIndex];
+			}
+		}
+
+		// Adjust the weights of the network by the gradient.
+		// Divide the trainingCount to make it an average gradient though, and multiply by the learning rate
+		nn.UpdateWeights(gradientSum, learningRate / float(trainingCount));
+	}
+}
+
+// Reports how far through an epoch the training is, each time it goes up by a tenth of a percent
+struct EpochProgress
+{
+	EpochProgress(size_t epoch, size_t epochItemCount)
+		: epoch(epoch)
+		, epochItemCount(epochItemCount)
+	{
+	}
+
+	// Call after training count more items
+	void Advance(size_t count)
+	{
+		itemsTrained += count;
+		Report(itemsTrained);
+	}
+
+	void Report(size_t itemsTrainedThisEpoch)
+	{
+		int percent = int(1000.0f * float(itemsTrainedThisEpoch) / float(epochItemCount));
+		if (percent != lastPercent)
+		{
+			lastPercent = percent;
+			printf("\r[Epoch %i/%i] %0.2f%%", (int)epoch + 1, (int)c_trainingEpochs, float(percent) / 10.0f);
+		}
+	}
+
+	size_t epoch = 0;
+	size_t epochItemCount = 0;
+	size_t itemsTrained = 0;
+	int lastPercent = -1;
+};
+
+// The part of training that is the same for every way of training: making the network, timing, evaluating and reporting each epoch,
+// and reporting and saving the results at the end.
+// TrainEpoch(nn, rng, epoch, progress) trains one epoch, of epochItemCount items, and tells progress how far along it is.
+template <typename TRAIN_EPOCH>
+void TrainEpochs(size_t epochItemCount, const DataSet& testingData, const char* name, TRAIN_EPOCH TrainEpoch)
+{
+	// Remember when the training started so we can report the time duration later
+	std::chrono::high_resolution_clock::time_point trainingStart = std::chrono::high_resolution_clock::now();
+
+	std::mt19937 rng = GetRNG();
+
+	TNeuralNetwork nn(rng);
+
+	// Each epoch is a training with the entire list of training data
+	std::vector<float> epochAccuracy(c_trainingEpochs);
+	TrainingStats stats;
+	EpochEvaluator evaluator(testingData, epochAccuracy, stats);
+	for (size_t epoch = 0; epoch < c_trainingEpochs; ++epoch)
+	{
+		// Remember when the epoch started so we can report the time duration later
+		std::chrono::high_resolution_clock::time_point epochStart = std::chrono::high_resolution_clock::now();
+
+		EpochProgress progress(epoch, epochItemCount);
+		TrainEpoch(nn, rng, epoch, progress);
+
+		float epochDuration = (float)std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - epochStart).count();
+		stats.trainingSeconds += epochDuration;
+		stats.samplesTrained += epochItemCount;
+		printf("\r[Epoch %i/%i] Duration: %s ", (int)epoch + 1, (int)c_trainingEpochs, MakeDurationString(epochDuration).c_str());
+		evaluator.OnEpochEnd(nn, epoch);
+	}
+	evaluator.Flush();
+
+	float trainingDuration = (float)std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - trainingStart).count();
+	printf("[Total] Duration %s ", MakeDurationString(trainingDuration).c_str());
+	NetworkQuality quality = EvaluateNetworkQuality(nn, testingData);
+	quality.Report();
+	stats.Report();
+
+	SaveResults(nn, epochAccuracy, quality, name);
+}
+
+// Trains on the items of trainingData in the given order, a mini batch at a time.
+// With PREFETCH_MINI_BATCHES(), each mini batch is gathered into a contiguous buffer by the prefetcher, while the one before it trains.
+// The items reach GetGradient in the given order, one at a time for the gradient functions that take a single item.
+template <typename TRAINING_DATA_SET, typename LAMBDA>
+void TrainInOrder(TNeuralNetwork& nn, std::mt19937& rng, const TRAINING_DATA_SET& trainingData, std::span<const int> order, LAMBDA& GetGradient, size_t miniBatchSize, float learningRate, EpochProgress& progress)
+{
+	using TDataItem = typename TRAINING_DATA_SET::value_type;
+
+	std::vector<float> gradientSum(TNeuralNetwork::c_numWeights);
+	std::vector<const TDataItem*> miniBatch(miniBatchSize);
+
+	#if PREFETCH_MINI_BATCHES()
+		#if AUGMENT_TRAINING_DATA()
+			MiniBatchPrefetcher<TDataItem, c_prefetchBufferCount> prefetcher(trainingData, order, miniBatchSize, c_prefetchThreadCount, true, rng());
+		#else
+			MiniBatchPrefetcher<TDataItem, c_prefetchBufferCount> prefetcher(trainingData, order, miniBatchSize);
+		#endif
+	#else
+		(void)rng;
+	#endif
+
+	// Do each mini batch
+	size_t trainingIndex = 0;
+	while (trainingIndex < order.size())
+	{
+		size_t trainingBeginIndex = trainingIndex;
+		size_t trainingEndIndex = std::min(trainingIndex + miniBatchSize, order.size());
+		size_t trainingCount = trainingEndIndex - trainingIndex;
+
+		// Returns an item of the mini batch, either from the prefetcher's staging buffer, or straight from the training data
+		#if PREFETCH_MINI_BATCHES()
+			std::span<const TDataItem> prefetchedMiniBatch = prefetcher.Acquire();
+			auto MiniBatchItem = [&](size_t index) -> const TDataItem& { return prefetchedMiniBatch[index]; };
+		#else
+			auto MiniBatchItem = [&](size_t index) -> const TDataItem& { return trainingData[order[trainingBeginIndex + index]]; };
+		#endif
+
+		TrainMiniBatch<TDataItem>(nn, GetGradient, MiniBatchItem, trainingCount, learningRate, gradientSum, miniBatch);
+		trainingIndex = trainingEndIndex;
+		progress.Advance(trainingCount);
+
+		#if PREFETCH_MINI_BATCHES()
+			prefetcher.Release();
+		#endif
+	}
+}
+
+// The training data can be a DataSet or a CompactDataSet. The testing data is always a DataSet.
+// miniBatchSize can be larger than c_miniBatchSize, to give a gradient function that splits the mini batch across threads more work per call.
+// The learning rate is scaled up with it, so that the average gradient of a larger mini batch still moves the weights as far per item.
+template <typename TRAINING_DATA_SET, typename LAMBDA>
+void Train(const TRAINING_DATA_SET& trainingData, const DataSet& testingData, LAMBDA GetGradient, const char* name, size_t miniBatchSize = c_miniBatchSize)
+{
+	const float learningRate = c_learningRate * float(miniBatchSize) / float(c_miniBatchSize);
+
+	// Make a list of indices in our training data. We'll shuffle this each epoch and then train in that order
+	std::vector<int> trainingOrder(trainingData.size());
+	std::iota(trainingOrder.begin(), trainingOrder.end(), 0);
+
+	TrainEpochs(trainingData.size(), testingData, name,
+		[&](TNeuralNetwork& nn, std::mt19937& rng, size_t epoch, EpochProgress& progress)
+		{
+			// randomize the order that we are going to use the training data in, for this epoch
+			std::shuffle(trainingOrder.begin(), trainingOrder.end(), rng);
+
+			TrainInOrder(nn, rng, trainingData, trainingOrder, GetGradient, miniBatchSize, learningRate, progress);
+		}
+	);
+}
+
+// Trains on a StreamingDataSet, one window of shuffled items at a time, instead of on a data set that is all in memory.
+// The mini batches are taken in order from each window, and the last mini batch of a window can be smaller than c_miniBatchSize.
+template <typename LAMBDA>
+void TrainStreaming(StreamingDataSet& trainingData, const DataSet& testingData, LAMBDA GetGradient, const char* name)
+{
+	std::vector<float> gradientSum(TNeuralNetwork::c_numWeights);
+	std::vector<const CompactDataItem*> miniBatch(c_miniBatchSize);
+
+	TrainEpochs(trainingData.size(), testingData, name,
+		[&](TNeuralNetwork& nn, std::mt19937& rng, size_t epoch, EpochProgress& progress)
+		{
+			// randomize the order of the shards, and start loading them
+			trainingData.BeginEpoch(rng);
+
+			for (std::span<const CompactDataItem> window = trainingData.AcquireWindow(); !window.empty(); window = trainingData.AcquireWindow())
+			{
+				// Do each mini batch in the window
+				for (size_t windowIndex = 0; windowIndex < window.size(); windowIndex += c_miniBatchSize)
+				{
+					size_t trainingCount = std::min(c_miniBatchSize, window.size() - windowIndex);
+					auto MiniBatchItem = [&](size_t index) -> const CompactDataItem& { return window[windowIndex + index]; };
+					TrainMiniBatch<CompactDataItem>(nn, GetGradient, MiniBatchItem, trainingCount, c_learningRate, gradientSum, miniBatch);
+					progress.Advance(trainingCount);
+				}
+
+				trainingData.ReleaseWindow();
+			}
+		}
+	);
+}
+
+// Trains with importance sampling: instead of going through a shuffled list of the training data, each mini batch is picked by an
+// ImportanceSampler, which favors the items that had a high cost when they were last trained on. Each item's gradient is multiplied
+// by its importance weight, so the mini batch gradient is still an unbiased estimate of the gradient of the whole training data.
+// The first epoch is a normal shuffled pass, which gives every item a cost. After that, each epoch is the same number of picks.
+// The cost of each picked item comes for free from its forward pass, and the sampler is rebuilt every c_importanceRebuildInterval
+// mini batches to pick using them. Picking only uses the costs from the last rebuild, so the picks up to the next rebuild are all
+// made at once, and trained on in that order, like the shuffled order of the other training.
+void TrainImportanceSampled(const DataSet& trainingData, const DataSet& testingData, const char* name)
+{
+	ImportanceSampler sampler(trainingData.size(), c_importanceUniformMix);
+
+	// The picks up to the next rebuild, and their order in the training data
+	std::vector<ImportanceSampler::Sample> samples;
+	std::vector<int> sampleOrder;
+
+	// The items reach the gradient function in the order of the samples, so it walks the samples alongside them
+	size_t sampleIndex = 0;
+	auto GetGradient = [&](TNeuralNetwork& nn, const DataItem& dataItem, std::span<float, TNeuralNetwork::c_numWeights> gradientSum)
+	{
+		const ImportanceSampler::Sample& sample = samples[sampleIndex++];
+		float cost = AccumulateGradient_BackpropWeighted(nn, dataItem, sample.weight, gradientSum);
+		sampler.SetLoss(sample.index, cost);
+	};
+
+	TrainEpochs(trainingData.size(), testingData, name,
+		[&](TNeuralNetwork& nn, std::mt19937& rng, size_t epoch, EpochProgress& progress)
+		{
+			size_t trainingIndex = 0;
+			while (trainingIndex < trainingData.size())
+			{
+				// The first epoch is one shuffled pass over all of the items. After that, the items are picked up to the next rebuild.
+				size_t trainingCount = trainingData.size() - trainingIndex;
+				if (epoch > 0)
+					trainingCount = std::min(trainingCount, c_miniBatchSize * c_importanceRebuildInterval);
+
+				samples.resize(trainingCount);
+				for (size_t index = 0; index < trainingCount; ++index)
+				{
+					if (epoch == 0)
+						samples[index] = ImportanceSampler::Sample{ index, 1.0f };
+					else
+						samples[index] = sampler.Draw(rng);
+				}
+				if (epoch == 0)
+					std::shuffle(samples.begin(), samples.end(), rng);
+
+				sampleOrder.resize(trainingCount);
+				for (size_t index = 0; index < trainingCount; ++index)
+					sampleOrder[index] = (int)samples[index].index;
+
+				sampleIndex = 0;
+				TrainInOrder(nn, rng, trainingData, sampleOrder, GetGradient, c_miniBatchSize, c_learningRate, progress);
+				sampler.Rebuild();
+				trainingIndex += trainingCount;
+			}
+		}
+	);
+}
+
+// Hogwild! style asynchronous training.
+// Every thread pulls the next item out of the shuffled training order, does sparse backprop on it, and applies the update
+// straight to the shared network, with no locks and no waiting for a mini batch to finish. Threads will sometimes read weights
+// that another thread is part way through updating, or overwrite each other's updates, but since most of each update is zero
+// (most of the input pixels are zero) the threads rarely touch the same weights and the training still converges.
+// See NeuralNetwork::ForwardPassAndBackpropHogwild().
+void TrainHogwild(const DataSet& trainingData, const DataSet& testingData, const char* name)
+{
+	// Make a list of indices in our training data. We'll shuffle this each epoch and then train in that order
+	std::vector<int> trainingOrder(trainingData.size());
+	std::iota(trainingOrder.begin(), trainingOrder.end(), 0);
+
+	// Each item is its own update, so scale the learning rate to take the same size step per item as the mini batch training does
+	const float learningRate = c_learningRate / float(c_miniBatchSize);
+
+	TrainEpochs(trainingData.size(), testingData, name,
+		[&](TNeuralNetwork& nn, std::mt19937& rng, size_t epoch, EpochProgress& progress)
+		{
+			// randomize the order that we are going to use the training data in, for this epoch
+			std::shuffle(trainingOrder.begin(), trainingOrder.end(), rng);
+
+			std::atomic<size_t> nextTrainingIndex = 0;
+			#if MULTI_THREADED()
+			#pragma omp parallel
+			#endif
+			{
+				while (true)
+				{
+					size_t trainingIndex = nextTrainingIndex.fetch_add(1, std::memory_order_relaxed);
+					if (trainingIndex >= trainingOrder.size())
+						break;
+
+					const DataItem& dataItem = trainingData[trainingOrder[trainingIndex]];
+					nn.ForwardPassAndBackpropHogwild(dataItem.image, trainingData.NonZeroIndices(dataItem), dataItem.label, learningRate);
+
+					// Only one thread reports progress
+					if (omp_get_thread_num() == 0)
+						progress.Report(trainingIndex);
+				}
+			}
+		}
+	);
+}
+
 int main(int argc, char** argv)
 {
 	_mkdir("out");
 
-	// Make the MNIST data into .png files.
+	// Make the data set into .png files.
 	// Not necessary, but it makes it easier to see what the training data looks like, having it on disk as pngs.
-	printf("Extracting MNIST Data...\n");
+#if EXTRACT_PNGS()
+	printf("Extracting %s PNGs...\n", TDataSetInfo::c_name);
+	ExtractMNISTPNGs();
+#endif
+
+	printf("Extracting %s Data...\n", TDataSetInfo::c_name);
 	DataSet trainingData, testingData;
 	ExtractMNISTData(trainingData, testingData);
 
 	// You can uncomment this if you want to train / test on a random subset of data.
+	// MakeOwned() copies the items out of the data set cache, if that's where they came from, so that they can be changed.
 	/*
-	std::shuffle(trainingData.begin(), trainingData.end(), GetRNG());
-	std::shuffle(testingData.begin(), testingData.end(), GetRNG());
-	trainingData.resize(100);
-	testingData.resize(100);
+	std::vector<DataItem>& trainingItems = trainingData.MakeOwned();
+	std::vector<DataItem>& testingItems = testingData.MakeOwned();
+	std::shuffle(trainingItems.begin(), trainingItems.end(), GetRNG());
+	std::shuffle(testingItems.begin(), testingItems.end(), GetRNG());
+	trainingItems.resize(100);
+	testingItems.resize(100);
+	trainingData.MakeNonZeroIndices();
 	*/
 
+	printf("Using %s kernels, with the %s sigmoid.\n", GetSIMDKernels().name, TSigmoid::c_name);
+
+	#if REPORT_SIGMOID_ACCURACY()
+		ReportSigmoidAccuracy();
+	#endif
+
+	#if BENCHMARK_GRADIENTS()
+		BenchmarkGradients(trainingData);
+	#endif
+
 	printf("MLP layers are: %i, %i, %i, for a total of %i weights to optimize.\n",
 		(int)TNeuralNetwork::c_numInputNeurons,
 		(int)TNeuralNetwork::c_numHiddenNeurons,
@@ -249,9 +880,80 @@ int main(int argc, char** argv)
 		Train(trainingData, testingData, GetGradient_DualNumbers, "DualNumbers.csv");
 	#endif
 
+	#if TRAIN_DUAL_NUMBERS_CHUNKED()
+		printf("\nTraining with chunked Dual Numbers...\n");
+		Train(trainingData, testingData, GetGradient_DualNumbersChunked, "DualNumbersChunked");
+	#endif
+
+	#if TRAIN_SPARSE_DUAL_NUMBERS()
+		printf("\nTraining with sparse Dual Numbers...\n");
+		Train(trainingData, testingData, GetGradient_SparseDualNumbers, "SparseDualNumbers");
+	#endif
+
+	#if TRAIN_TAPE()
+		printf("\nTraining with a Tape...\n");
+		Train(trainingData, testingData, GetGradient_Tape, "Tape");
+	#endif
+
 	#if TRAIN_BACKPROP()
 		printf("\nTraining with backprop...\n");
-		Train(trainingData, testingData, GetGradient_Backprop, "Backprop");
+		Train(trainingData, testingData, AccumulateGradient_Backprop, "Backprop");
+	#endif
+
+	#if TRAIN_BACKPROP_BATCHED()
+		printf("\nTraining with batched backprop...\n");
+		Train(trainingData, testingData, GetGradient_BackpropBatched, "BackpropBatched");
+	#endif
+
+	#if TRAIN_BACKPROP_PARALLEL()
+		printf("\nTraining with parallel batched backprop...\n");
+		Train(trainingData, testingData, GetGradient_BackpropParallel, "BackpropParallel", c_miniBatchSize * c_parallelMiniBatches);
+	#endif
+
+	#if TRAIN_BACKPROP_SPARSE()
+	{
+		printf("\nTraining with sparse backprop...\n");
+		auto GetGradient = [&trainingData](TNeuralNetwork& nn, const DataItem& dataItem, std::span<float, TNeuralNetwork::c_numWeights> gradientSum)
+		{
+			AccumulateGradient_BackpropSparse(nn, dataItem, trainingData.NonZeroIndices(dataItem), gradientSum);
+		};
+		Train(trainingData, testingData, GetGradient, "BackpropSparse");
+	}
+	#endif
+
+	#if TRAIN_BACKPROP_COMPACT()
+	{
+		printf("\nTraining with compact data backprop...\n");
+		CompactDataSet compactTrainingData;
+		ExtractMNISTTrainingData(compactTrainingData);
+		Train(compactTrainingData, testingData, AccumulateGradient_BackpropCompact, "BackpropCompact");
+	}
+	#endif
+
+	#if TRAIN_BACKPROP_STREAMING()
+	{
+		printf("\nTraining with streaming data backprop...\n");
+		StreamingDataSet streamingTrainingData(DataSetPath(TDataSetInfo::c_trainingLabelFileName).c_str(), DataSetPath(TDataSetInfo::c_trainingImageFileName).c_str(), c_streamingShardSize, c_streamingMemoryBudget);
+		if (streamingTrainingData.IsValid())
+		{
+			printf("Streaming %i items in %i shards, %i shards at a time.\n", (int)streamingTrainingData.size(), (int)streamingTrainingData.ShardCount(), (int)streamingTrainingData.ShardsPerWindow());
+			TrainStreaming(streamingTrainingData, testingData, AccumulateGradient_BackpropCompact, "BackpropStreaming");
+		}
+		else
+		{
+			printf("ERROR: could not stream the %s training data from %s and %s. Skipping streaming training.\n", TDataSetInfo::c_name, TDataSetInfo::c_trainingLabelFileName, TDataSetInfo::c_trainingImageFileName);
+		}
+	}
+	#endif
+
+	#if TRAIN_BACKPROP_IMPORTANCE()
+		printf("\nTraining with importance sampled backprop...\n");
+		TrainImportanceSampled(trainingData, testingData, "BackpropImportance");
+	#endif
+
+	#if TRAIN_BACKPROP_HOGWILD()
+		printf("\nTraining with Hogwild! backprop...\n");
+		TrainHogwild(trainingData, testingData, "BackpropHogwild");
 	#endif
 
 	return 0;